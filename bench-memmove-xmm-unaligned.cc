@@ -0,0 +1,453 @@
+/*
+  Benchmark as:
+    $ g++ -ggdb3 -O2 -m64 -mavx bench-memmove-xmm-unaligned.cc -o bench-memmove-xmm-unaligned -Wall && ./bench-memmove-xmm-unaligned
+  Options:
+    -k, --kernels=LIST     comma separated kernels to run (default: all supported):
+                             libc          - glibc memmove()
+                             si128u-x1     - 1x unrolled movdqu + movntdq loop (test-memmove-xmm-unaligned-1.cc)
+                             si128u-x8     - 8x unrolled movdqu + movntdq loop (test-memmove-xmm-unaligned.cc)
+                             si128u-x8-reg - same with regular movdqu stores: NT threshold reference
+                             si256u-x8     - 8x unrolled vmovdqu + vmovntdq, 256-bit (AVX2)
+                             si512u-x8     - 8x unrolled vmovdqu64 + vmovntdq, 512-bit (AVX-512F)
+        --min=KiB          smallest working set (default: 4)
+        --max=MiB          largest working set (default: 4096, capped at half of MemAvailable)
+    -r, --repeat=N         timed samples per (kernel, working set) (default: 11)
+        --overlap          move within one buffer at 64 bytes offset as the tests do,
+                           instead of copying first half of working set to second half
+        --cpu=N            pin to CPU N
+        --csv              print CSV instead of a table
+  Output example:
+    kernel         working_set  GB/s(median)       min      max   stddev cycles/byte
+    libc                32.0KiB       131.24    100.73   147.54    18.76      0.016
+    si128u-x8           32.0KiB        13.04     12.56    13.59     0.39      0.161
+    si128u-x8-reg       32.0KiB        61.16     54.31    63.96     4.10      0.034
+    ...
+
+  The idea:
+    Working set doubles from --min to --max. For each size every kernel gets a
+    warmup run and then --repeat timed samples, each sample repeats the move
+    until it took at least ~20ms. Throughput is bytes moved per second (a copy
+    of N bytes reads N and writes N bytes). Small working sets show L1/L2 speed,
+    large ones DRAM speed; where NT kernels overtake 'si128u-x8-reg' and 'libc'
+    is a good value for glibc.cpu.x86_non_temporal_threshold on this host.
+    A host whose DRAM-sized median is well below its siblings' has degraded
+    memory bandwidth (mis-seated DIMM, channel disabled, throttling).
+*/
+#include <string.h> /* memmove */
+#include <stdlib.h> /* exit */
+#include <stdio.h>  /* fprintf */
+#include <stdint.h> /* uint64_t */
+#include <math.h>   /* sqrt */
+
+#include <sys/mman.h> /* mmap() */
+#include <emmintrin.h> /* movdqu, sfence, movntdq */
+#include <immintrin.h> /* vmovdqu, vmovntdq, rdtsc */
+#include <getopt.h> /* getopt_long() */
+#include <sched.h> /* sched_setaffinity() */
+#include <time.h> /* clock_gettime() */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+typedef unsigned int u32;
+
+// Kernels are copies of the ones in tests, so the numbers are for exactly
+// the code that corrupted memory. All copy backwards in whole registers.
+
+static void memmove_si128u_x1 (__m128i_u * dest, __m128i_u const *src, size_t items) __attribute__((noinline));
+static void memmove_si128u_x1 (__m128i_u * dest, __m128i_u const *src, size_t items)
+{
+    dest += items - 1;
+    src  += items - 1;
+    _mm_sfence();
+    for (; items != 0; items-=1, dest-=1, src-=1)
+    {
+        __m128i xmm0 = _mm_loadu_si128(src-0); // movdqu
+        _mm_stream_si128(dest-0, xmm0); // movntdq
+    }
+    _mm_sfence();
+}
+
+template <bool Stream> static void memmove_si128u_x8 (__m128i_u * dest, __m128i_u const *src, size_t items) __attribute__((noinline));
+template <bool Stream> static void memmove_si128u_x8 (__m128i_u * dest, __m128i_u const *src, size_t items)
+{
+    dest += items - 1;
+    src  += items - 1;
+    _mm_sfence();
+    for (; items != 0; items-=8, dest-=8, src-=8)
+    {
+        __m128i xmm0 = _mm_loadu_si128(src-0); // movdqu
+        __m128i xmm1 = _mm_loadu_si128(src-1); // movdqu
+        __m128i xmm2 = _mm_loadu_si128(src-2); // movdqu
+        __m128i xmm3 = _mm_loadu_si128(src-3); // movdqu
+        __m128i xmm4 = _mm_loadu_si128(src-4); // movdqu
+        __m128i xmm5 = _mm_loadu_si128(src-5); // movdqu
+        __m128i xmm6 = _mm_loadu_si128(src-6); // movdqu
+        __m128i xmm7 = _mm_loadu_si128(src-7); // movdqu
+        if (Stream)
+        {
+            _mm_stream_si128(dest-0, xmm0); // movntdq
+            _mm_stream_si128(dest-1, xmm1); // movntdq
+            _mm_stream_si128(dest-2, xmm2); // movntdq
+            _mm_stream_si128(dest-3, xmm3); // movntdq
+            _mm_stream_si128(dest-4, xmm4); // movntdq
+            _mm_stream_si128(dest-5, xmm5); // movntdq
+            _mm_stream_si128(dest-6, xmm6); // movntdq
+            _mm_stream_si128(dest-7, xmm7); // movntdq
+        }
+        else
+        {
+            _mm_storeu_si128(dest-0, xmm0); // movdqu
+            _mm_storeu_si128(dest-1, xmm1); // movdqu
+            _mm_storeu_si128(dest-2, xmm2); // movdqu
+            _mm_storeu_si128(dest-3, xmm3); // movdqu
+            _mm_storeu_si128(dest-4, xmm4); // movdqu
+            _mm_storeu_si128(dest-5, xmm5); // movdqu
+            _mm_storeu_si128(dest-6, xmm6); // movdqu
+            _mm_storeu_si128(dest-7, xmm7); // movdqu
+        }
+    }
+    _mm_sfence();
+}
+
+static void memmove_si256u_x8 (__m256i * dest, __m256i const *src, size_t items) __attribute__((noinline, target("avx2")));
+static void memmove_si256u_x8 (__m256i * dest, __m256i const *src, size_t items)
+{
+    dest += items - 1;
+    src  += items - 1;
+    _mm_sfence();
+    for (; items != 0; items-=8, dest-=8, src-=8)
+    {
+        __m256i ymm0 = _mm256_loadu_si256(src-0); // vmovdqu
+        __m256i ymm1 = _mm256_loadu_si256(src-1); // vmovdqu
+        __m256i ymm2 = _mm256_loadu_si256(src-2); // vmovdqu
+        __m256i ymm3 = _mm256_loadu_si256(src-3); // vmovdqu
+        __m256i ymm4 = _mm256_loadu_si256(src-4); // vmovdqu
+        __m256i ymm5 = _mm256_loadu_si256(src-5); // vmovdqu
+        __m256i ymm6 = _mm256_loadu_si256(src-6); // vmovdqu
+        __m256i ymm7 = _mm256_loadu_si256(src-7); // vmovdqu
+        _mm256_stream_si256(dest-0, ymm0); // vmovntdq
+        _mm256_stream_si256(dest-1, ymm1); // vmovntdq
+        _mm256_stream_si256(dest-2, ymm2); // vmovntdq
+        _mm256_stream_si256(dest-3, ymm3); // vmovntdq
+        _mm256_stream_si256(dest-4, ymm4); // vmovntdq
+        _mm256_stream_si256(dest-5, ymm5); // vmovntdq
+        _mm256_stream_si256(dest-6, ymm6); // vmovntdq
+        _mm256_stream_si256(dest-7, ymm7); // vmovntdq
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+}
+
+static void memmove_si512u_x8 (__m512i * dest, __m512i const *src, size_t items) __attribute__((noinline, target("avx512f")));
+static void memmove_si512u_x8 (__m512i * dest, __m512i const *src, size_t items)
+{
+    dest += items - 1;
+    src  += items - 1;
+    _mm_sfence();
+    for (; items != 0; items-=8, dest-=8, src-=8)
+    {
+        __m512i zmm0 = _mm512_loadu_si512(src-0); // vmovdqu64
+        __m512i zmm1 = _mm512_loadu_si512(src-1); // vmovdqu64
+        __m512i zmm2 = _mm512_loadu_si512(src-2); // vmovdqu64
+        __m512i zmm3 = _mm512_loadu_si512(src-3); // vmovdqu64
+        __m512i zmm4 = _mm512_loadu_si512(src-4); // vmovdqu64
+        __m512i zmm5 = _mm512_loadu_si512(src-5); // vmovdqu64
+        __m512i zmm6 = _mm512_loadu_si512(src-6); // vmovdqu64
+        __m512i zmm7 = _mm512_loadu_si512(src-7); // vmovdqu64
+        _mm512_stream_si512(dest-0, zmm0); // vmovntdq
+        _mm512_stream_si512(dest-1, zmm1); // vmovntdq
+        _mm512_stream_si512(dest-2, zmm2); // vmovntdq
+        _mm512_stream_si512(dest-3, zmm3); // vmovntdq
+        _mm512_stream_si512(dest-4, zmm4); // vmovntdq
+        _mm512_stream_si512(dest-5, zmm5); // vmovntdq
+        _mm512_stream_si512(dest-6, zmm6); // vmovntdq
+        _mm512_stream_si512(dest-7, zmm7); // vmovntdq
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+}
+
+// Called through a pointer: no inlining or builtin expansion.
+static void * (* volatile libc_memmove) (void *, const void *, size_t) = memmove;
+
+static void run_libc (void * dest, void const * src, size_t bytes) { libc_memmove (dest, src, bytes); }
+static void run_si128u_x1 (void * dest, void const * src, size_t bytes) { memmove_si128u_x1 ((__m128i_u *)dest, (__m128i_u const *)src, bytes / 16); }
+static void run_si128u_x8 (void * dest, void const * src, size_t bytes) { memmove_si128u_x8<true> ((__m128i_u *)dest, (__m128i_u const *)src, bytes / 16); }
+static void run_si128u_x8_reg (void * dest, void const * src, size_t bytes) { memmove_si128u_x8<false> ((__m128i_u *)dest, (__m128i_u const *)src, bytes / 16); }
+static void run_si256u_x8 (void * dest, void const * src, size_t bytes) { memmove_si256u_x8 ((__m256i *)dest, (__m256i const *)src, bytes / 32); }
+static void run_si512u_x8 (void * dest, void const * src, size_t bytes) { memmove_si512u_x8 ((__m512i *)dest, (__m512i const *)src, bytes / 64); }
+
+static bool have_any (void) { return true; }
+static bool have_avx2 (void) { return __builtin_cpu_supports ("avx2"); }
+static bool have_avx512 (void) { return __builtin_cpu_supports ("avx512f"); }
+
+struct bench_kernel
+{
+    const char * name;
+    size_t block; // moves are a multiple of it
+    void (*run) (void * dest, void const * src, size_t bytes);
+    bool (*supported) (void);
+};
+
+static const bench_kernel kernels[] = {
+    { "libc",          1,       run_libc,          have_any },
+    { "si128u-x1",     16,      run_si128u_x1,     have_any },
+    { "si128u-x8",     8 * 16,  run_si128u_x8,     have_any },
+    { "si128u-x8-reg", 8 * 16,  run_si128u_x8_reg, have_any },
+    { "si256u-x8",     8 * 32,  run_si256u_x8,     have_avx2 },
+    { "si512u-x8",     8 * 64,  run_si512u_x8,     have_avx512 },
+};
+
+static struct
+{
+    const char * kernels; // 0: all supported
+    size_t min_size;      // bytes
+    size_t max_size;      // bytes
+    size_t repeat;
+    bool overlap;
+    int cpu;              // -1: do not pin
+    bool csv;
+} opts = { 0, 4 * 1024, 4096ULL * 1024 * 1024, 11, false, -1, false };
+
+static double now_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// MemAvailable from /proc/meminfo, in bytes.
+static size_t meminfo_available (void)
+{
+  FILE * f = fopen ("/proc/meminfo", "r");
+  size_t avail = 0;
+  if (!f)
+    return 0;
+  char line[256];
+  while (fgets (line, sizeof (line), f))
+  {
+    unsigned long long kb;
+    if (sscanf (line, "MemAvailable: %llu kB", &kb) == 1)
+      avail = kb * 1024;
+  }
+  fclose (f);
+  return avail;
+}
+
+struct sample
+{
+    double gbps;
+    double cycles_per_byte;
+};
+
+// Runs 'k' over working set of 'size' bytes at 'buf': warmup, then
+// opts.repeat samples of at least ~20ms each.
+static std::vector<sample> bench (const bench_kernel & k, char * buf, size_t size)
+{
+  // --overlap: backwards move by 64 bytes as in tests, otherwise first half to second half
+  size_t len = opts.overlap ? size - 64 : size / 2;
+  len -= len % k.block;
+  char * src = buf;
+  char * dst = opts.overlap ? buf + 64 : buf + size / 2;
+  std::vector<sample> samples;
+  if (len == 0)
+    return samples;
+
+  // warmup: faults in TLB, caches and CPU frequency; sizes reps for ~20ms
+  size_t reps = 1;
+  for (;;)
+  {
+    double t0 = now_seconds ();
+    for (size_t r = 0; r < reps; r++)
+      k.run (dst, src, len);
+    double t = now_seconds () - t0;
+    if (t >= 0.02)
+      break;
+    reps = t > 0.001 ? (size_t)(reps * 0.025 / t) + 1 : reps * 16;
+  }
+
+  for (size_t s = 0; s < opts.repeat; s++)
+  {
+    double t0 = now_seconds ();
+    uint64_t c0 = __rdtsc ();
+    for (size_t r = 0; r < reps; r++)
+      k.run (dst, src, len);
+    uint64_t c1 = __rdtsc ();
+    double t = now_seconds () - t0;
+    samples.push_back (sample { len * reps / t / 1e9, (double)(c1 - c0) / (len * reps) });
+  }
+  return samples;
+}
+
+static void print_size (char * out, size_t outlen, size_t size)
+{
+  if (size >= 1024 * 1024 * 1024)
+    snprintf (out, outlen, "%.1fGiB", size / (1024.0 * 1024 * 1024));
+  else if (size >= 1024 * 1024)
+    snprintf (out, outlen, "%.1fMiB", size / (1024.0 * 1024));
+  else
+    snprintf (out, outlen, "%.1fKiB", size / 1024.0);
+}
+
+static void report (const bench_kernel & k, size_t size, std::vector<sample> & samples)
+{
+  if (samples.empty ())
+    return;
+  std::sort (samples.begin (), samples.end (), [] (const sample & a, const sample & b) { return a.gbps < b.gbps; });
+  double sum = 0, sq = 0;
+  for (auto & s : samples)
+    sum += s.gbps;
+  double mean = sum / samples.size ();
+  for (auto & s : samples)
+    sq += (s.gbps - mean) * (s.gbps - mean);
+  double stddev = samples.size () > 1 ? sqrt (sq / (samples.size () - 1)) : 0;
+  const sample & median = samples[samples.size () / 2];
+
+  if (opts.csv)
+    printf ("%s,%zu,%.3f,%.3f,%.3f,%.3f,%.3f\n", k.name, size, median.gbps,
+            samples.front ().gbps, samples.back ().gbps, stddev, median.cycles_per_byte);
+  else
+  {
+    char ws[32];
+    print_size (ws, sizeof (ws), size);
+    printf ("%-14s %11s  %11.2f %9.2f %8.2f %8.2f %10.3f\n", k.name, ws, median.gbps,
+            samples.front ().gbps, samples.back ().gbps, stddev, median.cycles_per_byte);
+  }
+  fflush (stdout);
+}
+
+static void usage (const char * argv0)
+{
+  fprintf (stderr,
+           "Usage: %s [options]\n"
+           "  -k, --kernels=LIST     kernels: libc, si128u-x1, si128u-x8, si128u-x8-reg, si256u-x8, si512u-x8\n"
+           "                         (default: all supported)\n"
+           "      --min=KiB          smallest working set (default: 4)\n"
+           "      --max=MiB          largest working set (default: 4096)\n"
+           "  -r, --repeat=N         timed samples per point (default: 11)\n"
+           "      --overlap          move by 64 bytes within buffer as tests do\n"
+           "      --cpu=N            pin to CPU N\n"
+           "      --csv              CSV output\n"
+           "  -h, --help             this help\n",
+           argv0);
+}
+
+static size_t parse_size (const char * argv0, const char * arg)
+{
+  char * end;
+  unsigned long long v = strtoull (arg, &end, 0);
+  if (*arg == '\0' || *end != '\0')
+  {
+    fprintf (stderr, "%s: bad number '%s'\n", argv0, arg);
+    exit (1);
+  }
+  return v;
+}
+
+static void parse_args (int argc, char * argv[])
+{
+  enum { OPT_MIN = 256, OPT_MAX, OPT_OVERLAP, OPT_CPU, OPT_CSV };
+  static const struct option long_opts[] = {
+    { "kernels", required_argument, 0, 'k' },
+    { "min",     required_argument, 0, OPT_MIN },
+    { "max",     required_argument, 0, OPT_MAX },
+    { "repeat",  required_argument, 0, 'r' },
+    { "overlap", no_argument,       0, OPT_OVERLAP },
+    { "cpu",     required_argument, 0, OPT_CPU },
+    { "csv",     no_argument,       0, OPT_CSV },
+    { "help",    no_argument,       0, 'h' },
+    { 0, 0, 0, 0 },
+  };
+
+  for (;;)
+  {
+    int c = getopt_long (argc, argv, "k:r:h", long_opts, 0);
+    if (c == -1) break;
+    switch (c)
+    {
+      case 'k': opts.kernels = optarg; break;
+      case OPT_MIN: opts.min_size = parse_size (argv[0], optarg) * 1024; break;
+      case OPT_MAX: opts.max_size = parse_size (argv[0], optarg) * 1024 * 1024; break;
+      case 'r': opts.repeat = parse_size (argv[0], optarg); break;
+      case OPT_OVERLAP: opts.overlap = true; break;
+      case OPT_CPU: opts.cpu = parse_size (argv[0], optarg); break;
+      case OPT_CSV: opts.csv = true; break;
+      case 'h': usage (argv[0]); exit (0);
+      default: usage (argv[0]); exit (1);
+    }
+  }
+  if (optind != argc || opts.repeat == 0 || opts.min_size == 0 || opts.min_size > opts.max_size)
+  {
+    usage (argv[0]);
+    exit (1);
+  }
+}
+
+int main (int argc, char * argv[])
+{
+  parse_args (argc, argv);
+
+  std::vector<const bench_kernel *> selected;
+  std::string list = opts.kernels ? opts.kernels : "";
+  for (auto & k : kernels)
+  {
+    bool wanted = !opts.kernels || ("," + list + ",").find (std::string (",") + k.name + ",") != std::string::npos;
+    if (!wanted)
+      continue;
+    if (!k.supported ())
+    {
+      if (opts.kernels)
+        fprintf (stderr, "%s: kernel '%s' is not supported by this CPU, skipped\n", argv[0], k.name);
+      continue;
+    }
+    selected.push_back (&k);
+  }
+  if (selected.empty ())
+  {
+    fprintf (stderr, "%s: no kernels to run\n", argv[0]);
+    exit (1);
+  }
+
+  if (opts.cpu >= 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (opts.cpu, &set);
+    if (sched_setaffinity (0, sizeof (set), &set) != 0)
+      perror ("sched_setaffinity");
+  }
+
+  // don't push the host into swap or OOM killer
+  size_t avail = meminfo_available ();
+  if (avail && opts.max_size > avail / 2)
+  {
+    opts.max_size = avail / 2;
+    fprintf (stderr, "limiting working set to %zu MiB (half of MemAvailable)\n", opts.max_size >> 20);
+  }
+
+  // one pre-faulted buffer for all sizes, page aligned for NT stores
+  char * buf = (char *)mmap (0, opts.max_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (buf == MAP_FAILED)
+  {
+    perror ("mmap");
+    exit (1);
+  }
+  madvise (buf, opts.max_size, MADV_HUGEPAGE);
+  memset (buf, '!', opts.max_size);
+
+  if (opts.csv)
+    printf ("kernel,working_set_bytes,gbps_median,gbps_min,gbps_max,gbps_stddev,cycles_per_byte\n");
+  else
+    printf ("%-14s %11s  %11s %9s %8s %8s %10s\n", "kernel", "working_set", "GB/s(median)", "min", "max", "stddev", "cycles/byte");
+
+  for (size_t size = opts.min_size; size <= opts.max_size; size *= 2)
+    for (auto k : selected)
+    {
+      std::vector<sample> samples = bench (*k, buf, size);
+      report (*k, size, samples);
+    }
+
+  munmap (buf, opts.max_size);
+}
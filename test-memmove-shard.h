@@ -0,0 +1,146 @@
+/*
+  Sharded mode (PROCS > 0) of the C tests, shared by test-memmove.c and
+  test-memmove-xmm-unaligned.c. Include after do_memmove() and now_seconds().
+
+  A 32-bit process can not map much more than 3GB, so the supervisor forks
+  PROCS workers, each testing a buffer of its own, together covering as much
+  RAM as needed. Workers publish counters in a shared anonymous mapping.
+  A worker killed by a crash or by the OOM killer is restarted instead of
+  taking the whole run down, at most shard_max_restarts times: a shard that
+  keeps dying (or can not be forked) is given up on.
+
+  Exit status: 1 if a bad result was seen, 2 if no bad result was seen but
+  a shard crashed, was given up on or never ran, 0 otherwise.
+*/
+
+#include <signal.h> /* SIGKILL */
+#include <unistd.h> /* fork() */
+
+#include <sys/mman.h> /* mmap() */
+#include <sys/prctl.h> /* PR_SET_PDEATHSIG */
+#include <sys/wait.h> /* waitpid() */
+
+static const int shard_max_restarts = 5;
+
+struct shard
+{
+    volatile int pid;  // 0: not running
+    volatile int done; // PASSES or SECONDS reached
+    int failed;        // given up on after shard_max_restarts
+    int restarts;      // crashes and failed forks
+    unsigned long long passes, errors;
+};
+
+static void test_shard (struct shard * sh, size_t size, size_t passes, double deadline)
+{
+  prctl (PR_SET_PDEATHSIG, SIGKILL); // do not outlive supervisor
+  void * buf = malloc(size);
+  if (!buf)
+  {
+    fprintf (stderr, "shard pid %d: failed to allocate %zu bytes\n", getpid (), size);
+    _exit (2);
+  }
+  mlock (buf, size);
+  while (!passes || sh->passes < passes) {
+    size_t errors = do_memmove((u32 *)buf, size / sizeof (u32), sh->passes);
+    __atomic_add_fetch (&sh->errors, errors, __ATOMIC_RELAXED);
+    __atomic_add_fetch (&sh->passes, 1, __ATOMIC_RELAXED);
+    if (deadline > 0 && now_seconds () >= deadline)
+      break;
+  }
+  sh->done = 1;
+  _exit (0);
+}
+
+// Counts a crash or failed fork of shard 'i', gives up on it past the cap.
+static void shard_restart (struct shard * sh, int i)
+{
+  if (++sh->restarts > shard_max_restarts)
+  {
+    sh->failed = 1;
+    fprintf (stderr, "shard %d: failed %d times, giving up on it\n", i, sh->restarts);
+  }
+}
+
+static int supervise (int procs, size_t size, size_t passes, double seconds)
+{
+  struct shard * shards = (struct shard *)mmap (0, procs * sizeof (struct shard), PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shards == MAP_FAILED)
+  {
+    perror ("mmap");
+    exit (1);
+  }
+  double start = now_seconds ();
+  double deadline = seconds > 0 ? start + seconds : 0;
+  double next_stats = start + 10;
+  unsigned long long total_passes = 0, errors = 0, restarts = 0;
+  int failed = 0;
+  for (;;)
+  {
+    int alive = 0, pending = 0;
+    double now = now_seconds ();
+    for (int i = 0; i < procs; i++)
+    {
+      struct shard * sh = &shards[i];
+      int status;
+      if (sh->pid && waitpid (sh->pid, &status, WNOHANG) == sh->pid)
+      {
+        if (!sh->done)
+        {
+          if (WIFSIGNALED (status))
+            fprintf (stderr, "shard %d: pid %d killed by signal %d\n", i, sh->pid, WTERMSIG (status));
+          else
+            fprintf (stderr, "shard %d: pid %d exited with status %d\n", i, sh->pid, WEXITSTATUS (status));
+          shard_restart (sh, i);
+        }
+        sh->pid = 0;
+      }
+      if (!sh->pid && !sh->done && !sh->failed && (!deadline || now < deadline))
+      {
+        pid_t pid = fork ();
+        if (pid == 0)
+          test_shard (sh, size, passes, deadline);
+        if (pid < 0)
+        {
+          perror ("fork");
+          shard_restart (sh, i);
+        }
+        else
+          sh->pid = pid;
+      }
+      alive += sh->pid != 0;
+      // failed fork: try again next round
+      pending += !sh->pid && !sh->done && !sh->failed && (!deadline || now < deadline);
+    }
+
+    total_passes = errors = restarts = 0;
+    failed = 0;
+    for (int i = 0; i < procs; i++)
+    {
+      total_passes += __atomic_load_n (&shards[i].passes, __ATOMIC_RELAXED);
+      errors += __atomic_load_n (&shards[i].errors, __ATOMIC_RELAXED);
+      restarts += shards[i].restarts;
+      failed += shards[i].failed;
+    }
+    if (!alive && !pending)
+      break;
+    if (now >= next_stats)
+    {
+      fprintf (stderr, "stats: time=%.0fs procs=%d alive=%d held=%.2fGB passes=%llu tested=%.1fGB errors=%llu restarts=%llu failed=%d\n",
+               now - start, procs, alive, (double)procs * size / 1e9, total_passes,
+               total_passes * (size / 2) / 1e9, errors, restarts, failed);
+      next_stats += 10;
+    }
+    sleep (1);
+  }
+
+  double elapsed = now_seconds () - start;
+  double tested = (double)total_passes * (size / 2);
+  fprintf (stderr, "done: procs=%d held=%.2fGB passes=%llu tested=%.1fGB in %.1fs (%.2fGB/s) errors=%llu restarts=%llu failed=%d\n",
+           procs, (double)procs * size / 1e9, total_passes, tested / 1e9, elapsed,
+           elapsed > 0 ? tested / elapsed / 1e9 : 0, errors, restarts, failed);
+  if (errors)
+    return 1;
+  return restarts || failed || !total_passes ? 2 : 0;
+}
@@ -3,6 +3,16 @@
     $ gcc -ggdb3 -O2 -m32 test-memmove-xmm-unaligned.c -o test-memmove-xmm-unaligned -Wall && ./test-memmove-xmm-unaligned
     $ gcc -ggdb3 -O2 -m64 -mavx test-memmove-xmm-unaligned.c -o test-memmove-xmm-unaligned-64 -Wall && nice -n19 ./test-memmove-xmm-unaligned-64-avx128
     $ gcc -ggdb3 -O2 -m32 -mavx test-memmove-xmm-unaligned.c -o test-memmove-xmm-unaligned-32-avx128 -Wall && nice -n19 ./test-memmove-xmm-unaligned-32-avx128
+  Bounded run:
+    $ ./test-memmove-xmm-unaligned [PASSES [SECONDS [PROCS]]]
+    stops after PASSES memmove passes or SECONDS seconds (0 or missing: no limit),
+    prints GB tested per second and exits with status 1 if a bad result was seen.
+  Sharded run:
+    PROCS > 0 forks PROCS test processes with a buffer each (PASSES count per process),
+    so 32-bit builds can cover all of RAM; a process that crashes or gets OOM-killed is
+    restarted (a few times at most), counters are collected in shared memory and printed
+    every 10 seconds. Exit status is 2 if a shard crashed but no bad result was seen.
+    See test-memmove-shard.h.
   Error example:
     Bad result in memmove(dst=0xd7cf5094, src=0xd7cf5010, len=268435456): offset= 8031729; expected=007A8DF1( 8031729) actual=007A8DF3( 8031731) bit_mismatch=00000002; iteration=2
     Bad result in memmove(dst=0xd7cf5094, src=0xd7cf5010, len=268435456): offset=43626993; expected=0299B1F1(43626993) actual=0299B1F3(43626995) bit_mismatch=00000002; iteration=3
@@ -13,12 +23,20 @@
 #include <string.h> /* memmove */
 #include <stdlib.h> /* exit */
 #include <stdio.h>  /* fprintf */
+#include <time.h>   /* clock_gettime() */
 
 #include <sys/mman.h> /* mlock() */
 #include <emmintrin.h> /* movdqu, sfence, movntdq */
 
 typedef unsigned int u32;
 
+static double now_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 static void memmove_si128u (__m128i_u * dest, __m128i_u const *src, size_t items) __attribute__((noinline));
 static void memmove_si128u (__m128i_u * dest, __m128i_u const *src, size_t items)
 {
@@ -71,11 +89,12 @@ static void memmove_si128u (__m128i_u * dest, __m128i_u const *src, size_t items
     _mm_sfence();
 }
 
-static void do_memmove (u32 * buf, size_t buf_elements, size_t iter) __attribute__((noinline));
-static void do_memmove (u32 * buf, size_t buf_elements, size_t iter)
+static size_t do_memmove (u32 * buf, size_t buf_elements, size_t iter) __attribute__((noinline));
+static size_t do_memmove (u32 * buf, size_t buf_elements, size_t iter)
 {
   size_t elements_to_move = buf_elements / 2;
   size_t salt = 0x51515151;
+  size_t errors = 0;
 
   // "memset" buffer with 0, 1, 2, 3, ...
   for (u32 i = 0; i < elements_to_move; i++) buf[i] = i + salt;
@@ -92,24 +111,44 @@ static void do_memmove (u32 * buf, size_t buf_elements, size_t iter)
     u32 v = dst[i];
     u32 e = i + salt;
     if (v != e)
+    {
       fprintf (stderr,
                "Bad result in memmove(dst=%p, src=%p, len=%zd)"
                ": offset=%8u; expected=%08X(%8u) actual=%08X(%8u) bit_mismatch=%08X; iteration=%zu\n",
                dst, buf, elements_to_move * sizeof (u32),
                i, e, e, v, v, v^e, iter);
+      errors++;
+    }
   }
+  return errors;
 }
 
-int main (void)
+#include "test-memmove-shard.h"
+
+int main (int argc, char * argv[])
 {
+  size_t passes = argc > 1 ? strtoul (argv[1], 0, 0) : 0;
+  double seconds = argc > 2 ? strtod (argv[2], 0) : 0;
+  int procs = argc > 3 ? atoi (argv[3]) : 0;
   //size_t size = 8 * 1024 * 1024;
   //size_t size = 8 * 1024 * 1024;
   size_t size = 1 * 1024 * 1024 * 1024;
+  if (procs > 0)
+    return supervise (procs, size, passes, seconds);
   void * buf = malloc(size);
   mlock (buf, size);
+  double start = now_seconds ();
+  size_t n = 0, errors = 0;
   // wait for a failure
-  for (size_t n = 0; ;++n) {
-    do_memmove(buf, size / sizeof (u32), n);
+  while (!passes || n < passes) {
+    errors += do_memmove(buf, size / sizeof (u32), n++);
+    if (seconds > 0 && now_seconds () - start >= seconds)
+      break;
   }
+  double elapsed = now_seconds () - start;
+  double tested = (double)n * (size / 2);
+  fprintf (stderr, "done: held=%.2fGB passes=%zu tested=%.1fGB in %.1fs (%.2fGB/s) errors=%zu\n",
+           size / 1e9, n, tested / 1e9, elapsed, elapsed > 0 ? tested / elapsed / 1e9 : 0, errors);
   free(buf);
+  return errors ? 1 : 0;
 }
@@ -1,6 +1,132 @@
 /*
   Test as:
-    $ g++ -ggdb3 -O2 -m64 -mavx test-memmove-xmm-unaligned.cc -o test-memmove-xmm-unaligned-64-avx128 -Wall && nice -n19 ./test-memmove-xmm-unaligned-64-avx128
+    $ g++ -ggdb3 -O2 -m64 -mavx -pthread test-memmove-xmm-unaligned.cc -o test-memmove-xmm-unaligned-64-avx128 -Wall && nice -n19 ./test-memmove-xmm-unaligned-64-avx128
+  Options:
+    -j, --threads=N        number of worker threads (default: one per CPU we are allowed to run on)
+        --no-pin           do not pin worker threads to CPUs
+    -k, --kernel=NAME      force memmove kernel: avx512, avx2 or sse2 (default: widest supported by CPU)
+    -p, --store=POLICY     how kernels write destination (default: nt):
+                             nt         - movntdq/vmovntdq non-temporal stores
+                             movdqu     - regular stores
+                             clflushopt - regular stores, clflushopt of each line once written
+                             clwb       - regular stores, clwb of each line once written
+                             movsb      - backwards 'rep movsb' instead of vector loop
+                           Comma separated list (e.g. 'nt,movdqu') alternates policies on the
+                           same buffer between passes; stats are then split per policy.
+    -r, --headroom=MiB     available memory to leave to the rest of the system (default: 5% of RAM,
+                           at least 256MB)
+        --grow-step=MiB    max stash growth per second while ramping up (default: 1/16 of RAM,
+                           at least 1GiB, so full coverage is reached in ~16 seconds at most)
+    -a, --alloc=NAME       buffer allocator backend (default: populate):
+                             malloc     - plain posix_memalign()
+                             populate   - mmap(MAP_POPULATE), pre-faulted 4K pages
+                             hugetlb    - mmap(MAP_HUGETLB) 2MB pages (needs vm.nr_hugepages;
+                                          stash stops growing when the pool runs out)
+                             hugetlb-1g - mmap(MAP_HUGETLB) 1GB pages
+                             thp        - 2MB aligned mmap() + madvise(MADV_HUGEPAGE), pre-faulted
+        --numa[=MODE]      NUMA mode: discover nodes from sysfs, spread workers over nodes and
+                           bind their buffers with set_mempolicy(MPOL_BIND); MODE is 'local'
+                           (default, memory of worker's own node) or 'cross' (next node's memory).
+                           Bandwidth and errors are reported per memory node.
+        --error-format=FMT format of error lines: text (default), json (JSON lines) or csv.
+                           Errors are deduplicated per (address, bit_mismatch): a site is
+                           printed on its 1st, 2nd, 4th, 8th, ... hit with a running count.
+        --error-log=FILE   append error lines to FILE instead of stderr
+        --error-rate=N     print at most N error lines per second (default: 20), the rest
+                           is summarized once a second
+        --pattern=LIST     data patterns, rotated between passes (default: all):
+                             seq     - i + key, neighbouring words differ in low bits only
+                             hash    - 32-bit integer hash of (i ^ key), all bits vary
+                             walk1   - single 1 bit walking over words
+                             walk0   - single 0 bit walking over words
+                             checker - 0x55555555 / 0xAAAAAAAA checkerboard
+                             all     - all of the above
+                           'key' changes on every pass, so stale data from a previous pass
+                           does not look correct. Fill and verify generate the pattern with
+                           SIMD from word offset, no reference copy is kept. Patterns that
+                           repeat over the move distance (checker always, walks at multiples
+                           of 32 words) would verify clean where a store was lost: such
+                           memmove passes take the next pattern of the list, or seq, and
+                           checker only ends up in --checksum stash fills.
+        --streams=N[,N...] split each memmove into N parts copied at the same time, one 64-byte
+                           line of each part in turn, to keep more write-combining buffers
+                           busy than the CPU has (10-12 on Intel, more on AMD) and force partial
+                           line evictions. Destination is the other buffer half. Several
+                           counts rotate between passes and phase stats are split per count,
+                           showing how throughput falls off; errors name their stream, or
+                           'tail' (-1 in json/csv) for the remainder under 64 bytes per stream
+                           that does not split evenly and is copied after all streams.
+        --load=KIND[@GBPS][,KIND[@GBPS]...]
+                           start a background load thread per KIND next to the workers:
+                           'read' (loads only), 'write' (NT stores only) or 'copy' (both)
+                           over a buffer of its own; @GBPS caps its bandwidth (default: as
+                           fast as it goes). Stats then show load bandwidth, total bandwidth
+                           with the test and, once errors are seen, error rate per total
+                           bandwidth bucket.
+        --load-size=MiB    buffer size per load thread (default: 256, well above LLC)
+        --load-sibling     pin load thread i to the SMT sibling of worker i's CPU, so the
+                           checker shares its core's load/store path with the load
+        --checksum         fill stash chunks with the --pattern rotation instead of '!' and
+                           keep a CRC32C per 4KiB block taken right after the fill. Rechecks
+                           rehash blocks at read bandwidth and diff words against the pattern
+                           only in blocks whose checksum changed.
+        --verifier         start a background thread rechecking idle stash chunks one after
+                           another (on top of one recheck per worker iteration), so memory
+                           held by the test is re-read many times a minute
+        --perf             count cycles, instructions, LLC load/store misses and offcore
+                           memory (node) loads/stores with perf_event_open() around each
+                           do_memmove() phase. Stats show IPC and events per KiB moved for
+                           the last interval and, once errors are seen, for clean and failing
+                           passes of the whole run; --journal keeps counters of every pass.
+                           Needs kernel.perf_event_paranoid <= 2 and a PMU visible to the
+                           (virtual) machine.
+        --focus[=SEC]      when a pass finds errors, mlock() 64KiB around the bad word and
+                           retest only that window for SEC seconds (default: 10) with rotating
+                           patterns, store policies, move distances and source misalignment,
+                           then print how many passes reproduced an error and how many hit
+                           the same word. Each page is focused on once; stash chunks with
+                           focused errors are never given back to the system.
+        --passes=K         stop once stash stopped growing and every byte held by the test
+                           (stash chunks and scratch buffers) was a memmove destination K
+                           times. Not with --sweep, whose moves leave gaps between them
+        --time=SEC         stop after SEC seconds
+        --bytes=GB         stop after testing GB gigabytes (1e9 bytes)
+                           Bounded runs print held memory, passes it was covered by and
+                           average GB/s, and exit with status 1 if any error was seen, 0
+                           otherwise. Without any of them the test runs until killed.
+        --shm=NAME         publish live stats (iterations, tested bytes per store policy,
+                           GB/s, stash size, errors per flipped bit and most frequent
+                           bit_mismatch values) in a fixed layout block (struct shm_stats)
+                           in /dev/shm/NAME, refreshed every 100ms. Readers mmap() it and
+                           retry a copy while 'seq' is odd or changed under them. The
+                           file is left in place with last numbers when the test exits.
+        --sweep            instead of one move over half of the buffer run many moves of
+                           sizes around glibc memmove() dispatch points (size classes, rep
+                           movsb and non-temporal thresholds, from GLIBC_TUNABLES or L3 size)
+                           with random src/dst misalignment, overlap distance and direction,
+                           alternating libc memmove() and the test kernel
+        --verify=MODE      how memmove result is read back: 'cached' (default) reads it right
+                           away with regular loads, partly from CPU caches; 'dram' flushes
+                           source after fill and destination after memmove with clflushopt
+                           and verifies with movntdqa streaming loads, so both memmove and
+                           verify go to DRAM
+        --reread-delay=MS  once per iteration, after verify of last scratch pass wait MS
+                           milliseconds, flush and verify its destination from DRAM again
+                           to catch retention-type failures
+        --journal=FILE     keep an append-only run journal in mmap()ed FILE: per-iteration stats,
+                           errors and physical ranges held by the test. Records are written
+                           with plain stores and msync()ed every stats interval, so they
+                           survive a crash or reboot.
+        --journal-size=MiB journal file size (default: 1024, sparse)
+        --resume           reload existing --journal and continue its iteration numbering,
+                           counters and error index instead of starting over
+        --dimm-map=FILE    translate physical addresses of errors to DIMM/channel labels,
+                           one '<first phys addr> <last phys addr> <label>' range per line (hex)
+    -s, --chunk-size=MiB   size of per-thread scratch buffer and of stash chunks (default: 128)
+    -i, --interval=SEC     print aggregated stats every SEC seconds (default: 10): bandwidth,
+                           and per phase (fill, memmove, verify) min/median/max GB/s and
+                           TSC cycles per byte over iterations since previous stats line
+        --json             print stats as JSON lines on stdout instead of text on stderr
   Error example:
     Bad result in memmove(dst=0xd7cf5094, src=0xd7cf5010, len=268435456): offset= 8031729; expected=007A8DF1( 8031729) actual=007A8DF3( 8031731) bit_mismatch=00000002; iteration=2
     Bad result in memmove(dst=0xd7cf5094, src=0xd7cf5010, len=268435456): offset=43626993; expected=0299B1F1(43626993) actual=0299B1F3(43626995) bit_mismatch=00000002; iteration=3
@@ -13,11 +139,31 @@
   Note: 'movdq' (_mm_stream_si128) does not cause the error.
 
   Test operation details:
-  - test allocates 128MB chunks and does 400 memmove_si128u() iterations on the last allocated chunk
+  - test starts a worker thread per CPU, each worker owns a 128MB scratch buffer and runs
+    memmove_si128u() + validation over it in parallel with other workers. Scratch buffer
+    is allocated once (pre-faulted, optionally backed by huge pages) and reused.
+  - a pass moves one half of the buffer; even passes write the lower half, odd passes copy
+    it to the upper half, so every byte of a buffer is a memmove destination every two passes
+  - while no errors were seen, test grows a stash of 128MB chunks filled with '!' in
+    large steps until only --headroom of memory is available (MemAvailable and cgroup v2
+    memory.max), holds it there and gives chunks back when available memory drops below
+    half of headroom, so the OOM killer is never triggered
+  - each worker iteration also runs memmove + validation over both halves of least recently
+    tested stash chunk (and refills it with '!') and rechecks '!' fill of another idle chunk, so all
+    memory held by the test gets exercised, not just scratch buffers
+  - with --checksum stash fill is a pattern and rechecks compare per-block CRC32C sums
+    against the index taken at fill time; --verifier adds a thread doing nothing but
+    rechecks, so decay of long-resident memory is caught within seconds
   - on bad hardware test usually corrupts one bit of RAM (test verifies RAM contents)
-  - on machines without RAM problems test silently OOMs
+  - on machines without RAM problems test keeps testing all memory it could take
   - on machines with RAM problems test keeps reporting 'Bad result in memmove...' (as above)
 
+  Error attribution:
+  - when ran as root each error is translated to a physical address via /proc/self/pagemap
+    and counted per (physical page, bit_mismatch); the stats line is followed by a summary
+    of most frequently failing physical pages (and DIMMs if --dimm-map is given). That saves
+    reshuffling DIMMs by hand as described below.
+
   Observed failure details on my machine:
   - over past 7 years I have experienced rare SIGSEGVs in userspace and kernel space
     without meaningful backtraces. It always looked as a memory corruption.
@@ -132,15 +278,112 @@
 #include <stdlib.h> /* exit */
 #include <stdio.h>  /* fprintf */
 
+#include <stdint.h> /* uint64_t */
+#include <errno.h> /* errno */
+#include <fcntl.h> /* open() */
+
 #include <sys/mman.h> /* mlock() */
+#include <linux/perf_event.h> /* perf_event_attr */
+#include <sys/syscall.h> /* SYS_set_mempolicy */
+#include <sys/stat.h> /* fstat() */
+#include <dirent.h> /* opendir() */
 #include <emmintrin.h> /* movdqu, sfence, movntdq */
+#include <immintrin.h> /* vmovdqu, vmovntdq on ymm/zmm */
+#include <getopt.h> /* getopt_long() */
+#include <pthread.h> /* pthread_setaffinity_np() */
+#include <sched.h> /* sched_getaffinity() */
+#include <time.h> /* clock_gettime() */
+#include <unistd.h> /* sleep() */
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <thread>
 #include <vector>
 
 typedef unsigned int u32;
 
-static void memmove_si128u (__m128i_u * dest, __m128i_u const *src, size_t items) __attribute__((noinline));
-static void memmove_si128u (__m128i_u * dest, __m128i_u const *src, size_t items)
+// How memmove kernels write destination. Policy is a template parameter
+// of kernels, so each instantiation has a branch-free inner loop.
+enum store_policy
+{
+    STORE_NT,         // movntdq: this causes single bit memory corruption
+    STORE_MOVDQU,     // movdqu: this would work
+    STORE_CLFLUSHOPT, // movdqu + clflushopt of written line
+    STORE_CLWB,       // movdqu + clwb of written line
+    STORE_MOVSB,      // backwards 'rep movsb' instead of vector loop
+    STORE_POLICIES
+};
+static const char * const store_names[STORE_POLICIES] = { "nt", "movdqu", "clflushopt", "clwb", "movsb" };
+
+// clflushopt/clwb targets are enabled for all instantiations:
+// compiler never emits these instructions on its own.
+// Stores write only: flush policies flush lines with flush_line*().
+template <int Store> static inline void store_si128 (__m128i_u * p, __m128i v) __attribute__((always_inline, target("clflushopt,clwb")));
+template <int Store> static inline void store_si128 (__m128i_u * p, __m128i v)
+{
+    if (Store == STORE_NT)
+        _mm_stream_si128((__m128i *)p, v); // movntdq
+    else
+        _mm_storeu_si128(p, v); // movdqu
+}
+
+template <int Store> static inline void store_si256 (__m256i_u * p, __m256i v) __attribute__((always_inline, target("avx2,clflushopt,clwb")));
+template <int Store> static inline void store_si256 (__m256i_u * p, __m256i v)
+{
+    if (Store == STORE_NT)
+        _mm256_stream_si256((__m256i *)p, v); // vmovntdq
+    else
+        _mm256_storeu_si256(p, v); // vmovdqu
+}
+
+template <int Store> static inline void store_si512 (__m512i * p, __m512i v) __attribute__((always_inline, target("avx512f,clflushopt,clwb")));
+template <int Store> static inline void store_si512 (__m512i * p, __m512i v)
+{
+    if (Store == STORE_NT)
+        _mm512_stream_si512(p, v); // vmovntdq
+    else
+        _mm512_storeu_si512(p, v); // vmovdqu64
+}
+
+// clflushopt/clwb policies flush each written 64-byte line once, after
+// all of its stores: flushing after every register store would flush a
+// line 2-4 times, and re-dirty lines already on their way out.
+template <int Store> static inline void flush_line (const void * p) __attribute__((always_inline, target("clflushopt,clwb")));
+template <int Store> static inline void flush_line (const void * p)
+{
+    if (Store == STORE_CLFLUSHOPT)
+        _mm_clflushopt((void *)p);
+    if (Store == STORE_CLWB)
+        _mm_clwb((void *)p);
+}
+
+// Backwards kernels: flushes lines from '*line' down to the one starting at
+// or above 'lo' (the lowest byte written so far) and moves '*line' past them.
+template <int Store> static inline void flush_lines_down (uintptr_t * line, uintptr_t lo) __attribute__((always_inline, target("clflushopt,clwb")));
+template <int Store> static inline void flush_lines_down (uintptr_t * line, uintptr_t lo)
+{
+    if (Store != STORE_CLFLUSHOPT && Store != STORE_CLWB)
+        return;
+    for (; *line >= lo; *line -= 64)
+        flush_line<Store>((const void *)*line);
+}
+
+// Flushes every line [lo, hi) touches.
+template <int Store> static inline void flush_lines (uintptr_t lo, uintptr_t hi) __attribute__((always_inline, target("clflushopt,clwb")));
+template <int Store> static inline void flush_lines (uintptr_t lo, uintptr_t hi)
+{
+    uintptr_t line = (hi - 1) & ~(uintptr_t)63;
+    if (lo < hi)
+        flush_lines_down<Store> (&line, lo & ~(uintptr_t)63);
+}
+
+template <int Store> static void memmove_si128u (__m128i_u * dest, __m128i_u const *src, size_t items) __attribute__((noinline, target("clflushopt,clwb")));
+template <int Store> static void memmove_si128u (__m128i_u * dest, __m128i_u const *src, size_t items)
 {
     // emulate behaviour of optimised block for __memmove_sse2_unaligned:
     // sfence
@@ -187,6 +430,8 @@ static void memmove_si128u (__m128i_u * dest, __m128i_u const *src, size_t items
        0x0000000000000b64 <+132>:   sfence 
        0x0000000000000b67 <+135>:   retq
      */
+    uintptr_t first = (uintptr_t)dest & ~(uintptr_t)63;
+    uintptr_t line = ((uintptr_t)(dest + items) - 1) & ~(uintptr_t)63;
     dest += items - 1;
     src  += items - 1;
     _mm_sfence();
@@ -200,113 +445,3664 @@ static void memmove_si128u (__m128i_u * dest, __m128i_u const *src, size_t items
         __m128i xmm5 = _mm_loadu_si128(src-5); // movdqu
         __m128i xmm6 = _mm_loadu_si128(src-6); // movdqu
         __m128i xmm7 = _mm_loadu_si128(src-7); // movdqu
-        if (0)
+        // STORE_MOVDQU would work, STORE_NT (movntdq) causes single bit memory corruption
+        store_si128<Store>(dest-0, xmm0);
+        store_si128<Store>(dest-1, xmm1);
+        store_si128<Store>(dest-2, xmm2);
+        store_si128<Store>(dest-3, xmm3);
+        store_si128<Store>(dest-4, xmm4);
+        store_si128<Store>(dest-5, xmm5);
+        store_si128<Store>(dest-6, xmm6);
+        store_si128<Store>(dest-7, xmm7);
+        flush_lines_down<Store>(&line, (uintptr_t)(dest-7));
+    }
+    flush_lines_down<Store>(&line, first);
+    _mm_sfence();
+}
+
+// Same loop as memmove_si128u() but with 256-bit registers. Mimics
+// __memmove_avx_unaligned_erms large copy path: 8x vmovdqu + 8x vmovntdq %ymm{N}.
+// 'dest' has to be 32-byte aligned.
+template <int Store> static void memmove_si256u (__m256i_u * dest, __m256i_u const *src, size_t items) __attribute__((noinline, target("avx2,clflushopt,clwb")));
+template <int Store> static void memmove_si256u (__m256i_u * dest, __m256i_u const *src, size_t items)
+{
+    uintptr_t first = (uintptr_t)dest & ~(uintptr_t)63;
+    uintptr_t line = ((uintptr_t)(dest + items) - 1) & ~(uintptr_t)63;
+    dest += items - 1;
+    src  += items - 1;
+    _mm_sfence();
+    for (; items != 0; items-=8, dest-=8, src-=8)
+    {
+        __m256i ymm0 = _mm256_loadu_si256(src-0); // vmovdqu
+        __m256i ymm1 = _mm256_loadu_si256(src-1); // vmovdqu
+        __m256i ymm2 = _mm256_loadu_si256(src-2); // vmovdqu
+        __m256i ymm3 = _mm256_loadu_si256(src-3); // vmovdqu
+        __m256i ymm4 = _mm256_loadu_si256(src-4); // vmovdqu
+        __m256i ymm5 = _mm256_loadu_si256(src-5); // vmovdqu
+        __m256i ymm6 = _mm256_loadu_si256(src-6); // vmovdqu
+        __m256i ymm7 = _mm256_loadu_si256(src-7); // vmovdqu
+        store_si256<Store>(dest-0, ymm0);
+        store_si256<Store>(dest-1, ymm1);
+        store_si256<Store>(dest-2, ymm2);
+        store_si256<Store>(dest-3, ymm3);
+        store_si256<Store>(dest-4, ymm4);
+        store_si256<Store>(dest-5, ymm5);
+        store_si256<Store>(dest-6, ymm6);
+        store_si256<Store>(dest-7, ymm7);
+        flush_lines_down<Store>(&line, (uintptr_t)(dest-7));
+    }
+    flush_lines_down<Store>(&line, first);
+    _mm_sfence();
+    _mm256_zeroupper();
+}
+
+// 512-bit variant: mimics __memmove_avx512_unaligned_erms large copy path
+// (8x vmovdqu64 + 8x vmovntdq %zmm{N}). 'dest' has to be 64-byte aligned.
+template <int Store> static void memmove_si512u (__m512i * dest, __m512i const *src, size_t items) __attribute__((noinline, target("avx512f,clflushopt,clwb")));
+template <int Store> static void memmove_si512u (__m512i * dest, __m512i const *src, size_t items)
+{
+    uintptr_t first = (uintptr_t)dest & ~(uintptr_t)63;
+    uintptr_t line = ((uintptr_t)(dest + items) - 1) & ~(uintptr_t)63;
+    dest += items - 1;
+    src  += items - 1;
+    _mm_sfence();
+    for (; items != 0; items-=8, dest-=8, src-=8)
+    {
+        __m512i zmm0 = _mm512_loadu_si512(src-0); // vmovdqu64
+        __m512i zmm1 = _mm512_loadu_si512(src-1); // vmovdqu64
+        __m512i zmm2 = _mm512_loadu_si512(src-2); // vmovdqu64
+        __m512i zmm3 = _mm512_loadu_si512(src-3); // vmovdqu64
+        __m512i zmm4 = _mm512_loadu_si512(src-4); // vmovdqu64
+        __m512i zmm5 = _mm512_loadu_si512(src-5); // vmovdqu64
+        __m512i zmm6 = _mm512_loadu_si512(src-6); // vmovdqu64
+        __m512i zmm7 = _mm512_loadu_si512(src-7); // vmovdqu64
+        store_si512<Store>(dest-0, zmm0);
+        store_si512<Store>(dest-1, zmm1);
+        store_si512<Store>(dest-2, zmm2);
+        store_si512<Store>(dest-3, zmm3);
+        store_si512<Store>(dest-4, zmm4);
+        store_si512<Store>(dest-5, zmm5);
+        store_si512<Store>(dest-6, zmm6);
+        store_si512<Store>(dest-7, zmm7);
+        flush_lines_down<Store>(&line, (uintptr_t)(dest-7));
+    }
+    flush_lines_down<Store>(&line, first);
+    _mm_sfence();
+    _mm256_zeroupper();
+}
+
+// Byte-granular backwards copy as done by __memmove_erms for overlapping
+// buffers with dest > src. Note: backwards 'rep movsb' does not take fast
+// string path on most CPUs.
+static void memmove_movsb (void * dest, void const * src, size_t bytes) __attribute__((noinline));
+static void memmove_movsb (void * dest, void const * src, size_t bytes)
+{
+    unsigned char * d = (unsigned char *)dest + bytes - 1;
+    unsigned char const * s = (unsigned char const *)src + bytes - 1;
+    __asm__ __volatile__ ("std\n\t"
+                          "rep movsb\n\t"
+                          "cld"
+                          : "+D" (d), "+S" (s), "+c" (bytes)
+                          :
+                          : "memory");
+}
+
+// Write-combining stress (--streams): splits the move into 'streams'
+// equal parts and copies them backwards at the same time, one 64-byte
+// line of each part in turn. Every part is a separate NT store stream,
+// so with enough of them line fill (WC) buffers run out and get evicted
+// partially filled. Parts must not overlap: caller copies to a separate
+// buffer half. Items that do not split evenly are copied last.
+template <int Store> static void memmove_streams_si128u (__m128i_u * dest, __m128i_u const *src, size_t items, size_t streams) __attribute__((noinline, target("clflushopt,clwb")));
+template <int Store> static void memmove_streams_si128u (__m128i_u * dest, __m128i_u const *src, size_t items, size_t streams)
+{
+    const size_t line = 64 / sizeof (__m128i);
+    size_t per = items / streams / line * line;
+    _mm_sfence();
+    for (size_t off = per; off != 0; off -= line)
+        for (size_t s = 0; s < streams; s++)
         {
-          // this would work:
-          _mm_storeu_si128(dest-0, xmm0);// movdqu
-          _mm_storeu_si128(dest-1, xmm1);// movdqu
-          _mm_storeu_si128(dest-2, xmm2);// movdqu
-          _mm_storeu_si128(dest-3, xmm3);// movdqu
-          _mm_storeu_si128(dest-4, xmm4);// movdqu
-          _mm_storeu_si128(dest-5, xmm5);// movdqu
-          _mm_storeu_si128(dest-6, xmm6);// movdqu
-          _mm_storeu_si128(dest-7, xmm7);// movdqu
+            __m128i_u const * p = src + s * per + off - line;
+            __m128i_u * d = dest + s * per + off - line;
+            __m128i xmm0 = _mm_loadu_si128(p+3); // movdqu
+            __m128i xmm1 = _mm_loadu_si128(p+2); // movdqu
+            __m128i xmm2 = _mm_loadu_si128(p+1); // movdqu
+            __m128i xmm3 = _mm_loadu_si128(p+0); // movdqu
+            store_si128<Store>(d+3, xmm0);
+            store_si128<Store>(d+2, xmm1);
+            store_si128<Store>(d+1, xmm2);
+            store_si128<Store>(d+0, xmm3);
+            flush_line<Store>(d);
         }
-        else
+    for (size_t i = items; i != streams * per; i--)
+        store_si128<Store>(dest + i - 1, _mm_loadu_si128(src + i - 1));
+    flush_lines<Store>((uintptr_t)(dest + streams * per), (uintptr_t)(dest + items));
+    _mm_sfence();
+}
+
+template <int Store> static void memmove_streams_si256u (__m256i_u * dest, __m256i_u const *src, size_t items, size_t streams) __attribute__((noinline, target("avx2,clflushopt,clwb")));
+template <int Store> static void memmove_streams_si256u (__m256i_u * dest, __m256i_u const *src, size_t items, size_t streams)
+{
+    const size_t line = 64 / sizeof (__m256i);
+    size_t per = items / streams / line * line;
+    _mm_sfence();
+    for (size_t off = per; off != 0; off -= line)
+        for (size_t s = 0; s < streams; s++)
         {
-          // this causes single bit memory corruption
-          _mm_stream_si128(dest-0, xmm0); // movntdq
-          _mm_stream_si128(dest-1, xmm1); // movntdq
-          _mm_stream_si128(dest-2, xmm2); // movntdq
-          _mm_stream_si128(dest-3, xmm3); // movntdq
-          _mm_stream_si128(dest-4, xmm4); // movntdq
-          _mm_stream_si128(dest-5, xmm5); // movntdq
-          _mm_stream_si128(dest-6, xmm6); // movntdq
-          _mm_stream_si128(dest-7, xmm7); // movntdq
+            __m256i_u const * p = src + s * per + off - line;
+            __m256i_u * d = dest + s * per + off - line;
+            __m256i ymm0 = _mm256_loadu_si256(p+1); // vmovdqu
+            __m256i ymm1 = _mm256_loadu_si256(p+0); // vmovdqu
+            store_si256<Store>(d+1, ymm0);
+            store_si256<Store>(d+0, ymm1);
+            flush_line<Store>(d);
         }
-    }
+    for (size_t i = items; i != streams * per; i--)
+        store_si256<Store>(dest + i - 1, _mm256_loadu_si256(src + i - 1));
+    flush_lines<Store>((uintptr_t)(dest + streams * per), (uintptr_t)(dest + items));
+    _mm_sfence();
+    _mm256_zeroupper();
+}
+
+template <int Store> static void memmove_streams_si512u (__m512i * dest, __m512i const *src, size_t items, size_t streams) __attribute__((noinline, target("avx512f,clflushopt,clwb")));
+template <int Store> static void memmove_streams_si512u (__m512i * dest, __m512i const *src, size_t items, size_t streams)
+{
+    size_t per = items / streams;
+    _mm_sfence();
+    for (size_t off = per; off != 0; off -= 1)
+        for (size_t s = 0; s < streams; s++)
+        {
+            __m512i zmm0 = _mm512_loadu_si512(src + s * per + off - 1); // vmovdqu64
+            store_si512<Store>(dest + s * per + off - 1, zmm0);
+            flush_line<Store>(dest + s * per + off - 1);
+        }
+    for (size_t i = items; i != streams * per; i--)
+        store_si512<Store>(dest + i - 1, _mm512_loadu_si512(src + i - 1));
+    flush_lines<Store>((uintptr_t)(dest + streams * per), (uintptr_t)(dest + items));
     _mm_sfence();
+    _mm256_zeroupper();
 }
 
-static bool seen_error = false;
+template <int Store> static void run_si128u (void * dest, void const * src, size_t items) { memmove_si128u<Store>((__m128i_u *)dest, (__m128i_u const *)src, items); }
+template <int Store> static void run_si256u (void * dest, void const * src, size_t items) { memmove_si256u<Store>((__m256i_u *)dest, (__m256i_u const *)src, items); }
+template <int Store> static void run_si512u (void * dest, void const * src, size_t items) { memmove_si512u<Store>((__m512i *)dest, (__m512i const *)src, items); }
+template <size_t Width> static void run_movsb (void * dest, void const * src, size_t items) { memmove_movsb(dest, src, items * Width); }
+template <int Store> static void run_streams_si128u (void * dest, void const * src, size_t items, size_t streams) { memmove_streams_si128u<Store>((__m128i_u *)dest, (__m128i_u const *)src, items, streams); }
+template <int Store> static void run_streams_si256u (void * dest, void const * src, size_t items, size_t streams) { memmove_streams_si256u<Store>((__m256i_u *)dest, (__m256i_u const *)src, items, streams); }
+template <int Store> static void run_streams_si512u (void * dest, void const * src, size_t items, size_t streams) { memmove_streams_si512u<Store>((__m512i *)dest, (__m512i const *)src, items, streams); }
+
+// Physical address attribution of bad cells.
+// /proc/self/pagemap gives page frame numbers only to CAP_SYS_ADMIN (root),
+// for other users PFNs read as 0 and errors are indexed by virtual page.
+static int pagemap_fd = -1;
+static size_t page_size = 4096;
 
-static void do_memmove (u32 * buf, size_t buf_elements, size_t iter) __attribute__((noinline));
-static void do_memmove (u32 * buf, size_t buf_elements, size_t iter)
+static bool virt_to_phys (const void * p, uint64_t * phys)
 {
-  size_t elements_to_move = buf_elements / 2;
-  size_t salt = 0x51515151;
+  if (pagemap_fd < 0)
+    return false;
+  uint64_t vaddr = (uintptr_t)p;
+  uint64_t entry;
+  if (pread (pagemap_fd, &entry, sizeof (entry), (vaddr / page_size) * sizeof (entry)) != sizeof (entry))
+    return false;
+  // bit 63: page present, bits 0-54: PFN
+  uint64_t pfn = entry & ((1ULL << 55) - 1);
+  if (!(entry & (1ULL << 63)) || pfn == 0)
+    return false;
+  *phys = pfn * page_size + vaddr % page_size;
+  return true;
+}
 
-  // "memset" buffer with 0, 1, 2, 3, ...
-  for (u32 i = 0; i < elements_to_move; i++) buf[i] = i + salt;
+// Physical address ranges to module names, loaded by --dimm-map.
+// Line format: <first phys addr> <last phys addr> <label>, e.g. taken from
+// EDAC/decode-dimms output or from memory controller documentation:
+//   0x0 0x1ffffffff ChannelA-DIMM0
+struct dimm_range
+{
+    uint64_t first, last;
+    std::string label;
+};
+static std::vector<dimm_range> dimm_map;
 
-  u32 * dst = buf + sizeof (__m128i) / sizeof (u32); // minimal offset: 16 bytes
+static void load_dimm_map (const char * path)
+{
+  FILE * f = fopen (path, "r");
+  if (!f)
+  {
+    fprintf (stderr, "failed to open dimm map '%s': %s\n", path, strerror (errno));
+    exit (1);
+  }
+  char line[256];
+  while (fgets (line, sizeof (line), f))
+  {
+    unsigned long long first, last;
+    char label[128];
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if (sscanf (line, "%llx %llx %127s", &first, &last, label) != 3)
+    {
+      fprintf (stderr, "bad dimm map line: %s", line);
+      exit (1);
+    }
+    dimm_map.push_back (dimm_range { first, last, label });
+  }
+  fclose (f);
+}
 
-  // __memmove_sse2_unaligned
-  // memmove(dst, buf, elements_to_move * sizeof (u32));
-  memmove_si128u((__m128i_u *)dst, (__m128i_u const *)buf, elements_to_move * sizeof (u32) / sizeof (__m128i));
+static const char * dimm_of (uint64_t phys)
+{
+  for (auto & r : dimm_map)
+    if (r.first <= phys && phys <= r.last)
+      return r.label.c_str ();
+  return "?";
+}
 
-  // validate target buffer buffer with 0, 1, 2, 3, ...
-  for (u32 i = 0; i < elements_to_move; i++)
+// Error index: how often each (page, bit mask) pair failed.
+struct error_site
+{
+    size_t hits;
+    size_t first_iter, last_iter;
+};
+// (page address, physical?, bit mismatch within u32 word)
+typedef std::tuple<uint64_t, bool, u32> error_key;
+static std::map<error_key, error_site> error_index;
+static std::mutex error_index_lock;
+
+// Adds a bad u32 at 'addr' to the index, a physical address if 'phys',
+// virtual otherwise: pages of both kinds are counted apart.
+static void index_error_at (uint64_t addr, bool phys, u32 mask, size_t iter)
+{
+  uint64_t page = addr & ~(uint64_t)(page_size - 1);
+  std::lock_guard<std::mutex> guard(error_index_lock);
+  auto r = error_index.insert (std::make_pair (error_key (page, phys, mask), error_site { 0, iter, iter }));
+  error_site & site = r.first->second;
+  site.hits++;
+  site.first_iter = std::min (site.first_iter, iter);
+  site.last_iter = std::max (site.last_iter, iter);
+}
+
+// 'phys': translation of 'p', 0 if unknown.
+static void index_error (const void * p, uint64_t phys, u32 mask, size_t iter)
+{
+  index_error_at (phys ? phys : (uintptr_t)p, phys != 0, mask, iter);
+}
+
+static void print_error_summary (void)
+{
+  std::lock_guard<std::mutex> guard(error_index_lock);
+  if (error_index.empty ())
+    return;
+
+  std::vector<std::pair<error_key, error_site>> sites (error_index.begin (), error_index.end ());
+  std::sort (sites.begin (), sites.end (), [] (const std::pair<error_key, error_site> & a,
+                                               const std::pair<error_key, error_site> & b) {
+    return a.second.hits > b.second.hits;
+  });
+
+  std::map<std::string, size_t> per_dimm;
+  for (auto & s : sites)
+    if (std::get<1> (s.first))
+      per_dimm[dimm_of (std::get<0> (s.first))] += s.second.hits;
+
+  fprintf (stderr, "error summary: %zu distinct (page, bit_mismatch) sites\n", sites.size ());
+  const size_t max_sites = 16;
+  for (size_t i = 0; i < sites.size () && i < max_sites; ++i)
   {
-    u32 v = dst[i];
-    u32 e = i + salt;
-    if (v != e)
+    const error_key & k = sites[i].first;
+    const error_site & site = sites[i].second;
+    fprintf (stderr, "  %s=%#014llx-%#014llx bit_mismatch=%08X hits=%zu iterations=%zu-%zu dimm=%s\n",
+             std::get<1> (k) ? "phys" : "virt",
+             (unsigned long long)std::get<0> (k),
+             (unsigned long long)(std::get<0> (k) + page_size - 1),
+             std::get<2> (k), site.hits, site.first_iter, site.last_iter,
+             std::get<1> (k) ? dimm_of (std::get<0> (k)) : "?");
+  }
+  if (sites.size () > max_sites)
+    fprintf (stderr, "  ... %zu more\n", sites.size () - max_sites);
+  for (auto & d : per_dimm)
+    fprintf (stderr, "  dimm=%s hits=%zu\n", d.first.c_str (), d.second);
+}
+
+// Error records. Verification loops only push compact records into
+// per-worker lock-free single-producer/single-consumer rings; address
+// translation, dedup, rate limiting and formatting happen in reporter
+// thread. Test loop keeps its pace even on badly broken hosts.
+struct error_record
+{
+    const u32 * addr;    // bad word
+    const void * base;   // memmove 'dst' or stash chunk
+    const void * src;    // memmove 'src', 0 for stash fill errors
+    size_t len;          // bytes
+    size_t iter;
+    u32 expected, actual;
+    const char * kernel; // 0 for stash fill errors
+    const char * store;
+    u32 streams;         // --streams parts of memmove, 0 or 1: single stream
+    uint64_t phys;       // physical address of 'addr', 0: unknown; set by push()
+};
+
+struct error_ring
+{
+    static const size_t capacity = 4096; // power of 2
+
+    alignas(64) std::atomic<size_t> head{0}; // next slot to write, owned by producer
+    alignas(64) std::atomic<size_t> tail{0}; // next slot to read, owned by consumer
+    std::atomic<size_t> dropped{0};          // records lost to full ring
+    const u32 * last_addr = 0;               // producer side: latest bad word, for --focus
+    uintptr_t last_page = 0;                 // producer side: translation cache of last_addr's page
+    size_t last_page_iter = 0;
+    uint64_t last_page_phys = 0;
+    error_record records[capacity];
+
+    // Address is translated here, while the memory is surely held: a stash
+    // chunk may be given back before reporter gets to the record. Bad words
+    // cluster, so pagemap is read once per page and iteration.
+    void push (const error_record & r)
     {
-      fprintf (stderr,
-               "Bad result in memmove(dst=%p, src=%p, len=%zd)"
-               ": offset=%8u; expected=%08X(%8u) actual=%08X(%8u) bit_mismatch=%08X; iteration=%zu\n",
-               dst, buf, elements_to_move * sizeof (u32),
-               i, e, e, v, v, v^e, iter);
-      seen_error = true;
+        last_addr = r.addr;
+        uintptr_t page = (uintptr_t)r.addr / page_size;
+        if (page != last_page || r.iter != last_page_iter)
+        {
+            last_page = page;
+            last_page_iter = r.iter;
+            if (!virt_to_phys ((const void *)(page * page_size), &last_page_phys))
+                last_page_phys = 0;
+        }
+        size_t h = head.load (std::memory_order_relaxed);
+        if (h - tail.load (std::memory_order_acquire) == capacity)
+        {
+            dropped.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+        records[h % capacity] = r;
+        records[h % capacity].phys = last_page_phys ? last_page_phys + (uintptr_t)r.addr % page_size : 0;
+        head.store (h + 1, std::memory_order_release);
     }
+
+    bool pop (error_record * r)
+    {
+        size_t t = tail.load (std::memory_order_relaxed);
+        if (t == head.load (std::memory_order_acquire))
+            return false;
+        *r = records[t % capacity];
+        tail.store (t + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// Ring of current worker thread.
+static thread_local error_ring * thread_error_ring = 0;
+
+// Data patterns of do_memmove(). Each word is a function of its offset
+// and of a key that changes on every call, so fill and verify compute
+// expected values from the offset alone (no reference copy) and a word
+// that missed this pass' store and still holds last pass' value fails.
+//   seq     - i + key, the original pattern
+//   hash    - counter-based: 32-bit integer hash of (i ^ key), all bits
+//             differ between neighbouring words
+//   walk1   - single 1 bit: 1 << ((i + key) % 32)
+//   walk0   - single 0 bit: ~walk1
+//   checker - 0x55555555 and 0xAAAAAAAA alternating by word
+enum pattern { PATTERN_SEQ, PATTERN_HASH, PATTERN_WALK1, PATTERN_WALK0, PATTERN_CHECKER, PATTERNS };
+static const char * const pattern_names[PATTERNS] = { "seq", "hash", "walk1", "walk0", "checker" };
+
+// Period in words, 0: does not repeat. Before a move 'dst' already holds
+// the fill of 'src' a distance away: when the pattern repeats over that
+// distance a store the memmove lost leaves the right value behind.
+static const size_t pattern_period[PATTERNS] = { 0, 0, 32, 32, 2 };
+
+// 'shift': words between source and destination of the move, 0: no move
+// (stash fill), SIZE_MAX: many distances in one pass (--sweep).
+static bool pattern_fits (int pattern, size_t shift)
+{
+  size_t period = pattern_period[pattern];
+  if (!shift || !period)
+    return true;
+  return shift != SIZE_MAX && shift % period != 0;
+}
+
+// lowbias32 by Chris Wellons: cheap and well mixing, only needs 32-bit
+// multiplies (pmulld) to vectorize.
+static inline u32 hash32 (u32 x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352d;
+  x ^= x >> 15;
+  x *= 0x846ca68b;
+  x ^= x >> 16;
+  return x;
+}
+
+static inline u32 pattern_word (int pattern, u32 key, size_t i)
+{
+  u32 n = (u32)i + key;
+  switch (pattern)
+  {
+    case PATTERN_HASH: return hash32 ((u32)i ^ key);
+    case PATTERN_WALK1: return 1u << (n % 32);
+    case PATTERN_WALK0: return ~(1u << (n % 32));
+    case PATTERN_CHECKER: return (n & 1) ? 0xAAAAAAAA : 0x55555555;
+    default: return n;
+  }
+}
+
+// Vector generators: pattern_first_*() returns words [i, i + lanes) and
+// their offsets in 'idx', pattern_next_*() steps both by 'lanes' words.
+// Only hash needs offsets, other patterns step the words themselves
+// (walking bit rotates by lane count, checkerboard repeats).
+// Low 32 bits of x * m per lane with SSE2 only (pmulld is SSE4.1):
+// pmuludq multiplies even lanes, odd lanes are shifted down to even.
+static inline __m128i mullo_si128 (__m128i x, u32 m) __attribute__((always_inline));
+static inline __m128i mullo_si128 (__m128i x, u32 m)
+{
+  __m128i k = _mm_set1_epi32 (m);
+  __m128i even = _mm_mul_epu32 (x, k);
+  __m128i odd = _mm_mul_epu32 (_mm_srli_epi64 (x, 32), k);
+  return _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, _MM_SHUFFLE (0, 0, 2, 0)),
+                             _mm_shuffle_epi32 (odd, _MM_SHUFFLE (0, 0, 2, 0)));
+}
+
+static inline __m128i hash_si128 (__m128i x) __attribute__((always_inline));
+static inline __m128i hash_si128 (__m128i x)
+{
+  x = _mm_xor_si128 (x, _mm_srli_epi32 (x, 16));
+  x = mullo_si128 (x, 0x7feb352d);
+  x = _mm_xor_si128 (x, _mm_srli_epi32 (x, 15));
+  x = mullo_si128 (x, 0x846ca68b);
+  return _mm_xor_si128 (x, _mm_srli_epi32 (x, 16));
+}
+
+template <int Pattern>
+static inline __m128i pattern_first_si128 (u32 key, size_t i, __m128i * idx) __attribute__((always_inline));
+template <int Pattern>
+static inline __m128i pattern_first_si128 (u32 key, size_t i, __m128i * idx)
+{
+  u32 n[4], w[4];
+  for (size_t j = 0; j < 4; j++)
+  {
+    n[j] = (u32)(i + j);
+    w[j] = pattern_word (Pattern, key, i + j);
+  }
+  *idx = _mm_loadu_si128 ((__m128i const *)n);
+  return _mm_loadu_si128 ((__m128i const *)w);
+}
+
+template <int Pattern>
+static inline __m128i pattern_next_si128 (__m128i e, __m128i * idx, u32 key) __attribute__((always_inline));
+template <int Pattern>
+static inline __m128i pattern_next_si128 (__m128i e, __m128i * idx, u32 key)
+{
+  const int lanes = sizeof (__m128i) / sizeof (u32);
+  switch (Pattern)
+  {
+    case PATTERN_SEQ:
+      return _mm_add_epi32 (e, _mm_set1_epi32 (lanes));
+    case PATTERN_HASH:
+      *idx = _mm_add_epi32 (*idx, _mm_set1_epi32 (lanes));
+      return hash_si128 (_mm_xor_si128 (*idx, _mm_set1_epi32 (key)));
+    case PATTERN_WALK1:
+    case PATTERN_WALK0:
+      return _mm_or_si128 (_mm_slli_epi32 (e, lanes), _mm_srli_epi32 (e, 32 - lanes));
+    default:
+      return e;
+  }
+}
+
+static inline __m256i hash_si256 (__m256i x) __attribute__((always_inline, target("avx2")));
+static inline __m256i hash_si256 (__m256i x)
+{
+  x = _mm256_xor_si256 (x, _mm256_srli_epi32 (x, 16));
+  x = _mm256_mullo_epi32 (x, _mm256_set1_epi32 (0x7feb352d));
+  x = _mm256_xor_si256 (x, _mm256_srli_epi32 (x, 15));
+  x = _mm256_mullo_epi32 (x, _mm256_set1_epi32 (0x846ca68b));
+  return _mm256_xor_si256 (x, _mm256_srli_epi32 (x, 16));
+}
+
+template <int Pattern>
+static inline __m256i pattern_first_si256 (u32 key, size_t i, __m256i * idx) __attribute__((always_inline, target("avx2")));
+template <int Pattern>
+static inline __m256i pattern_first_si256 (u32 key, size_t i, __m256i * idx)
+{
+  u32 n[8], w[8];
+  for (size_t j = 0; j < 8; j++)
+  {
+    n[j] = (u32)(i + j);
+    w[j] = pattern_word (Pattern, key, i + j);
+  }
+  *idx = _mm256_loadu_si256 ((__m256i const *)n);
+  return _mm256_loadu_si256 ((__m256i const *)w);
+}
+
+template <int Pattern>
+static inline __m256i pattern_next_si256 (__m256i e, __m256i * idx, u32 key) __attribute__((always_inline, target("avx2")));
+template <int Pattern>
+static inline __m256i pattern_next_si256 (__m256i e, __m256i * idx, u32 key)
+{
+  const int lanes = sizeof (__m256i) / sizeof (u32);
+  switch (Pattern)
+  {
+    case PATTERN_SEQ:
+      return _mm256_add_epi32 (e, _mm256_set1_epi32 (lanes));
+    case PATTERN_HASH:
+      *idx = _mm256_add_epi32 (*idx, _mm256_set1_epi32 (lanes));
+      return hash_si256 (_mm256_xor_si256 (*idx, _mm256_set1_epi32 (key)));
+    case PATTERN_WALK1:
+    case PATTERN_WALK0:
+      return _mm256_or_si256 (_mm256_slli_epi32 (e, lanes), _mm256_srli_epi32 (e, 32 - lanes));
+    default:
+      return e;
+  }
+}
+
+// gcc-12 warns about self-initialized _mm512_undefined_epi32() inside
+// avx512fintrin.h once these get inlined (gcc PR 105593).
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+static inline __m512i hash_si512 (__m512i x) __attribute__((always_inline, target("avx512f")));
+static inline __m512i hash_si512 (__m512i x)
+{
+  x = _mm512_xor_si512 (x, _mm512_srli_epi32 (x, 16));
+  x = _mm512_mullo_epi32 (x, _mm512_set1_epi32 (0x7feb352d));
+  x = _mm512_xor_si512 (x, _mm512_srli_epi32 (x, 15));
+  x = _mm512_mullo_epi32 (x, _mm512_set1_epi32 (0x846ca68b));
+  return _mm512_xor_si512 (x, _mm512_srli_epi32 (x, 16));
+}
+
+template <int Pattern>
+static inline __m512i pattern_first_si512 (u32 key, size_t i, __m512i * idx) __attribute__((always_inline, target("avx512f")));
+template <int Pattern>
+static inline __m512i pattern_first_si512 (u32 key, size_t i, __m512i * idx)
+{
+  u32 n[16], w[16];
+  for (size_t j = 0; j < 16; j++)
+  {
+    n[j] = (u32)(i + j);
+    w[j] = pattern_word (Pattern, key, i + j);
   }
+  *idx = _mm512_loadu_si512 (n);
+  return _mm512_loadu_si512 (w);
 }
 
-static std::vector<void *> ram_stash;
+template <int Pattern>
+static inline __m512i pattern_next_si512 (__m512i e, __m512i * idx, u32 key) __attribute__((always_inline, target("avx512f")));
+template <int Pattern>
+static inline __m512i pattern_next_si512 (__m512i e, __m512i * idx, u32 key)
+{
+  const int lanes = sizeof (__m512i) / sizeof (u32);
+  switch (Pattern)
+  {
+    case PATTERN_SEQ:
+      return _mm512_add_epi32 (e, _mm512_set1_epi32 (lanes));
+    case PATTERN_HASH:
+      *idx = _mm512_add_epi32 (*idx, _mm512_set1_epi32 (lanes));
+      return hash_si512 (_mm512_xor_si512 (*idx, _mm512_set1_epi32 (key)));
+    case PATTERN_WALK1:
+    case PATTERN_WALK0:
+      return _mm512_rol_epi32 (e, lanes);
+    default:
+      return e;
+  }
+}
+#pragma GCC diagnostic pop
+
+// Fill buf[i] with pattern word of offset i for i in [0, elements).
+template <int Pattern>
+static void fill_si128 (u32 * buf, size_t elements, u32 key) __attribute__((noinline));
+template <int Pattern>
+static void fill_si128 (u32 * buf, size_t elements, u32 key)
+{
+  const size_t lanes = sizeof (__m128i) / sizeof (u32);
+  __m128i idx;
+  __m128i e = pattern_first_si128<Pattern> (key, 0, &idx);
+  size_t i = 0;
+  for (; i + lanes <= elements; i += lanes)
+  {
+    _mm_storeu_si128 ((__m128i *)(buf + i), e);
+    e = pattern_next_si128<Pattern> (e, &idx, key);
+  }
+  for (; i < elements; i++)
+    buf[i] = pattern_word (Pattern, key, i);
+}
+
+template <int Pattern>
+static void fill_si256 (u32 * buf, size_t elements, u32 key) __attribute__((noinline, target("avx2")));
+template <int Pattern>
+static void fill_si256 (u32 * buf, size_t elements, u32 key)
+{
+  const size_t lanes = sizeof (__m256i) / sizeof (u32);
+  __m256i idx;
+  __m256i e = pattern_first_si256<Pattern> (key, 0, &idx);
+  size_t i = 0;
+  for (; i + lanes <= elements; i += lanes)
+  {
+    _mm256_storeu_si256 ((__m256i *)(buf + i), e);
+    e = pattern_next_si256<Pattern> (e, &idx, key);
+  }
+  _mm256_zeroupper();
+  for (; i < elements; i++)
+    buf[i] = pattern_word (Pattern, key, i);
+}
 
-static void take_ram(void)
+template <int Pattern>
+static void fill_si512 (u32 * buf, size_t elements, u32 key) __attribute__((noinline, target("avx512f")));
+template <int Pattern>
+static void fill_si512 (u32 * buf, size_t elements, u32 key)
 {
-    size_t size = 128 * 1024 * 1024;
-    fprintf(stderr, "alloc more: %zu\n", size);
-    void * chunk = malloc(size);
-    memset(chunk, '!', size);
-    ram_stash.push_back(chunk);
+  const size_t lanes = sizeof (__m512i) / sizeof (u32);
+  __m512i idx;
+  __m512i e = pattern_first_si512<Pattern> (key, 0, &idx);
+  size_t i = 0;
+  for (; i + lanes <= elements; i += lanes)
+  {
+    _mm512_storeu_si512 (buf + i, e);
+    e = pattern_next_si512<Pattern> (e, &idx, key);
+  }
+  _mm256_zeroupper();
+  for (; i < elements; i++)
+    buf[i] = pattern_word (Pattern, key, i);
 }
 
-static void free_ram(void)
+// What do_memmove() was doing when validation found a mismatch.
+struct verify_ctx
 {
-    if (!ram_stash.empty())
+    u32 const * dst;
+    u32 const * src;
+    size_t len; // bytes
+    size_t iter;
+    const char * kernel;
+    const char * store;
+    int pattern;
+    u32 key;
+    u32 streams;
+};
+
+// Slow path of verify_*(): rechecks 'count' words starting at 'first' one by one
+// and queues each mismatch for reporter thread. Kept out of line to keep it
+// away from hot loops.
+static size_t report_mismatches (const verify_ctx & ctx, size_t first, size_t count) __attribute__((noinline, cold));
+static size_t report_mismatches (const verify_ctx & ctx, size_t first, size_t count)
+{
+  size_t errors = 0;
+  for (size_t i = first; i < first + count; i++)
+  {
+    u32 v = ctx.dst[i];
+    u32 e = pattern_word (ctx.pattern, ctx.key, i);
+    if (v != e)
     {
-        fprintf(stderr, "freeing all stash\n");
-        auto p = ram_stash.begin();
-        auto e = ram_stash.end();
-        for (; p != e; ++p)
-            free (*p);
-        ram_stash.clear();
+      thread_error_ring->push (error_record { ctx.dst + i, ctx.dst, ctx.src, ctx.len, ctx.iter, e, v, ctx.kernel, ctx.store, ctx.streams, 0 });
+      errors++;
     }
+  }
+  return errors;
 }
 
-int main (void)
+// Validate dst[i] is pattern word of offset i for i in [0, elements).
+// Expected words are generated in a register alongside loads. 'Stream'
+// variants read with movntdqa streaming loads (see --verify=dram); for
+// sse2 that is verify_stream_si128() and verify_si128() ignores it.
+template <bool Stream, int Pattern>
+static size_t verify_si128 (const verify_ctx & ctx, size_t elements) __attribute__((noinline));
+template <bool Stream, int Pattern>
+static size_t verify_si128 (const verify_ctx & ctx, size_t elements)
 {
-  for (size_t n = 0; ;++n)
+  const size_t lanes = sizeof (__m128i) / sizeof (u32);
+  size_t errors = 0;
+  __m128i idx;
+  __m128i e = pattern_first_si128<Pattern> (ctx.key, 0, &idx);
+  size_t i = 0;
+  for (; i + lanes <= elements; i += lanes)
   {
-    size_t size = 128 * 1024 * 1024;
-    void * buf = malloc(size);
-    mlock (buf, size);
-    // wait for a failure
+    __m128i v = _mm_loadu_si128 ((__m128i const *)(ctx.dst + i));
+    if (__builtin_expect (_mm_movemask_epi8 (_mm_cmpeq_epi32 (v, e)) != 0xFFFF, 0))
+      errors += report_mismatches (ctx, i, lanes);
+    e = pattern_next_si128<Pattern> (e, &idx, ctx.key);
+  }
+  if (i < elements)
+    errors += report_mismatches (ctx, i, elements - i);
+  return errors;
+}
+
+// 128-bit movntdqa is SSE4.1, not SSE2: streaming variant of sse2 kernel
+// is a function of its own, --verify=dram checks the CPU has it.
+template <bool Stream, int Pattern>
+static size_t verify_stream_si128 (const verify_ctx & ctx, size_t elements) __attribute__((noinline, target("sse4.1")));
+template <bool Stream, int Pattern>
+static size_t verify_stream_si128 (const verify_ctx & ctx, size_t elements)
+{
+  const size_t lanes = sizeof (__m128i) / sizeof (u32);
+  size_t errors = 0;
+  // movntdqa needs aligned address: check unaligned head word by word
+  size_t i = std::min (elements, (-(uintptr_t)ctx.dst % sizeof (__m128i)) / sizeof (u32));
+  errors += report_mismatches (ctx, 0, i);
+  __m128i idx;
+  __m128i e = pattern_first_si128<Pattern> (ctx.key, i, &idx);
+  for (; i + lanes <= elements; i += lanes)
+  {
+    __m128i v = _mm_stream_load_si128 ((__m128i *)(ctx.dst + i));
+    if (__builtin_expect (_mm_movemask_epi8 (_mm_cmpeq_epi32 (v, e)) != 0xFFFF, 0))
+      errors += report_mismatches (ctx, i, lanes);
+    e = pattern_next_si128<Pattern> (e, &idx, ctx.key);
+  }
+  if (i < elements)
+    errors += report_mismatches (ctx, i, elements - i);
+  return errors;
+}
+
+template <bool Stream, int Pattern>
+static size_t verify_si256 (const verify_ctx & ctx, size_t elements) __attribute__((noinline, target("avx2")));
+template <bool Stream, int Pattern>
+static size_t verify_si256 (const verify_ctx & ctx, size_t elements)
+{
+  const size_t lanes = sizeof (__m256i) / sizeof (u32);
+  size_t errors = 0;
+  size_t i = 0;
+  if (Stream)
+  {
+    // movntdqa needs aligned address: check unaligned head word by word
+    i = std::min (elements, (-(uintptr_t)ctx.dst % sizeof (__m256i)) / sizeof (u32));
+    errors += report_mismatches (ctx, 0, i);
+  }
+  __m256i idx;
+  __m256i e = pattern_first_si256<Pattern> (ctx.key, i, &idx);
+  for (; i + lanes <= elements; i += lanes)
+  {
+    __m256i v = Stream ? _mm256_stream_load_si256 ((__m256i const *)(ctx.dst + i))
+                     : _mm256_loadu_si256 ((__m256i const *)(ctx.dst + i));
+    if (__builtin_expect (_mm256_movemask_epi8 (_mm256_cmpeq_epi32 (v, e)) != -1, 0))
+      errors += report_mismatches (ctx, i, lanes);
+    e = pattern_next_si256<Pattern> (e, &idx, ctx.key);
+  }
+  _mm256_zeroupper();
+  if (i < elements)
+    errors += report_mismatches (ctx, i, elements - i);
+  return errors;
+}
+
+template <bool Stream, int Pattern>
+static size_t verify_si512 (const verify_ctx & ctx, size_t elements) __attribute__((noinline, target("avx512f")));
+template <bool Stream, int Pattern>
+static size_t verify_si512 (const verify_ctx & ctx, size_t elements)
+{
+  const size_t lanes = sizeof (__m512i) / sizeof (u32);
+  size_t errors = 0;
+  size_t i = 0;
+  if (Stream)
+  {
+    // movntdqa needs aligned address: check unaligned head word by word
+    i = std::min (elements, (-(uintptr_t)ctx.dst % sizeof (__m512i)) / sizeof (u32));
+    errors += report_mismatches (ctx, 0, i);
+  }
+  __m512i idx;
+  __m512i e = pattern_first_si512<Pattern> (ctx.key, i, &idx);
+  for (; i + lanes <= elements; i += lanes)
+  {
+    __m512i v = Stream ? _mm512_stream_load_si512 ((void *)(ctx.dst + i))
+                     : _mm512_loadu_si512 (ctx.dst + i);
+    if (__builtin_expect (_mm512_cmpneq_epi32_mask (v, e) != 0, 0))
+      errors += report_mismatches (ctx, i, lanes);
+    e = pattern_next_si512<Pattern> (e, &idx, ctx.key);
+  }
+  _mm256_zeroupper();
+  if (i < elements)
+    errors += report_mismatches (ctx, i, elements - i);
+  return errors;
+}
+
+// Evicts [p, p + size) from all cache levels, so next read of it has to
+// come from DRAM. clflushopt is weakly ordered: fence it before reads.
+static void flush_range (const void * p, size_t size) __attribute__((noinline, target("clflushopt")));
+static void flush_range (const void * p, size_t size)
+{
+  static const bool have_clflushopt = __builtin_cpu_supports ("clflushopt");
+  const char * c = (const char *)((uintptr_t)p & ~(uintptr_t)63);
+  const char * end = (const char *)p + size;
+  if (have_clflushopt)
+    for (; c < end; c += 64)
+      _mm_clflushopt ((void *)c);
+  else
+    for (; c < end; c += 64)
+      _mm_clflush (c);
+  _mm_mfence ();
+}
+
+static bool have_sse2 (void) { return true; }
+static bool have_avx2 (void) { return __builtin_cpu_supports ("avx2"); }
+static bool have_avx512 (void) { return __builtin_cpu_supports ("avx512f"); }
+
+static bool store_supported (int store)
+{
+  switch (store)
+  {
+    case STORE_CLFLUSHOPT: return __builtin_cpu_supports ("clflushopt");
+    case STORE_CLWB: return __builtin_cpu_supports ("clwb");
+    default: return true;
+  }
+}
+
+typedef void (*memmove_fn) (void * dest, void const * src, size_t items);
+typedef void (*memmove_streams_fn) (void * dest, void const * src, size_t items, size_t streams);
+typedef size_t (*verify_fn) (const verify_ctx & ctx, size_t elements);
+typedef void (*fill_fn) (u32 * buf, size_t elements, u32 key);
+
+struct memmove_kernel
+{
+    const char * name;
+    size_t width; // bytes per register, also required 'dest' alignment
+    memmove_fn run[STORE_POLICIES];
+    memmove_streams_fn run_streams[STORE_POLICIES]; // no 'movsb'
+    fill_fn fill[PATTERNS];
+    verify_fn verify[PATTERNS];
+    verify_fn verify_dram[PATTERNS]; // streaming loads
+    bool (*supported) (void);
+};
+
+// Ordered from widest to narrowest: first supported one is the default.
+static const memmove_kernel kernels[] = {
+#define STORE_KERNELS(run, width) \
+    { run<STORE_NT>, run<STORE_MOVDQU>, run<STORE_CLFLUSHOPT>, run<STORE_CLWB>, run_movsb<width> }
+#define STREAM_KERNELS(run) \
+    { run<STORE_NT>, run<STORE_MOVDQU>, run<STORE_CLFLUSHOPT>, run<STORE_CLWB>, 0 }
+#define FILL_KERNELS(fill) \
+    { fill<PATTERN_SEQ>, fill<PATTERN_HASH>, fill<PATTERN_WALK1>, fill<PATTERN_WALK0>, fill<PATTERN_CHECKER> }
+#define VERIFY_KERNELS(verify, stream) \
+    { verify<stream, PATTERN_SEQ>, verify<stream, PATTERN_HASH>, verify<stream, PATTERN_WALK1>, \
+      verify<stream, PATTERN_WALK0>, verify<stream, PATTERN_CHECKER> }
+    { "avx512", sizeof (__m512i), STORE_KERNELS(run_si512u, 64), STREAM_KERNELS(run_streams_si512u),
+      FILL_KERNELS(fill_si512),
+      VERIFY_KERNELS(verify_si512, false), VERIFY_KERNELS(verify_si512, true), have_avx512 },
+    { "avx2",   sizeof (__m256i), STORE_KERNELS(run_si256u, 32), STREAM_KERNELS(run_streams_si256u),
+      FILL_KERNELS(fill_si256),
+      VERIFY_KERNELS(verify_si256, false), VERIFY_KERNELS(verify_si256, true), have_avx2 },
+    { "sse2",   sizeof (__m128i), STORE_KERNELS(run_si128u, 16), STREAM_KERNELS(run_streams_si128u),
+      FILL_KERNELS(fill_si128),
+      VERIFY_KERNELS(verify_si128, false), VERIFY_KERNELS(verify_stream_si128, true), have_sse2 },
+#undef VERIFY_KERNELS
+#undef FILL_KERNELS
+#undef STREAM_KERNELS
+#undef STORE_KERNELS
+};
+
+// Store policies to use, alternated between do_memmove() calls
+// on the same buffer when more than one is given (A/B mode).
+static std::vector<int> store_policies;
+static std::atomic<size_t> store_bytes[STORE_POLICIES];
+static std::atomic<size_t> store_errors[STORE_POLICIES];
+
+// --streams counts, rotated between do_memmove() calls.
+static std::vector<size_t> stream_counts;
+
+// Patterns to use, rotated between do_memmove() calls.
+static std::vector<int> patterns;
+static u32 pattern_seed = 0; // differs between runs
+
+static const memmove_kernel * kernel = 0;
+// Widest supported one: its fill and verify are used independently of forced kernel.
+static const memmove_kernel * widest = 0;
+
+static const memmove_kernel * pick_kernel (const char * name)
+{
+  for (auto & k : kernels)
+  {
+    if (name ? strcmp (name, k.name) == 0 : k.supported ())
+      return &k;
+  }
+  return 0;
+}
+
+static struct
+{
+    size_t threads;    // 0: one per allowed CPU
+    bool pin;
+    size_t chunk_size; // bytes
+    unsigned interval; // seconds between stats lines
+    const char * kernel; // 0: widest supported
+    const char * dimm_map; // 0: no physical address to module decoding
+    const char * alloc;    // buffer allocator backend name
+    const char * numa;     // 0: no NUMA placement, "local" or "cross"
+    bool json;             // stats as JSON lines on stdout instead of text on stderr
+    const char * store;    // comma separated store policies
+    size_t headroom;       // bytes of available memory to leave alone, 0: 5% of RAM
+    size_t grow_step;      // max bytes of stash to allocate per second, 0: 1/16 of RAM, at least 1GiB
+    const char * error_format; // "text", "json" or "csv"
+    const char * error_log;    // 0: stderr
+    size_t error_rate;         // max error lines per second
+    const char * journal;      // 0: no journal
+    size_t journal_size;       // bytes
+    bool resume;
+    bool verify_dram;          // flush caches and verify with streaming loads
+    unsigned reread_delay;     // ms, 0: no delayed second verify pass
+    const char * pattern;      // comma separated list of data patterns
+    bool sweep;                // many glibc-shaped moves instead of one huge one
+    const char * streams;      // comma separated list of concurrent store stream counts
+    const char * load;         // 0: no background load threads
+    size_t load_size;          // bytes per load thread
+    bool load_sibling;         // pin load threads to SMT siblings of workers
+    bool checksum;             // keyed stash fill with per-block checksum index
+    bool verifier;             // background stash recheck thread
+    bool perf;                 // hardware counters per phase
+    unsigned focus;            // seconds of focused retest after an error, 0: off
+    size_t passes;             // stop when all held memory had that many passes, 0: no limit
+    unsigned time;             // stop after that many seconds, 0: no limit
+    size_t bytes;              // stop after testing that many bytes, 0: no limit
+    const char * shm;          // 0: no live stats page
+} opts = { 0, true, 128 * 1024 * 1024, 10, 0, 0, "populate", 0, false, "nt", 0, 0, "text", 0, 20,
+           0, 1024 * 1024 * 1024, false, false, 0, "all", false, "1", 0, 256 * 1024 * 1024, false, false, false, false, 0,
+           0, 0, 0, 0 };
+
+// Buffer allocator backends. All return page aligned (or better) memory,
+// 0 on failure. 'size' is a multiple of allocator's granule.
+static void * alloc_malloc (size_t size)
+{
+  void * p = 0;
+  if (posix_memalign (&p, 4096, size) != 0)
+    return 0;
+  return p;
+}
+
+static void release_malloc (void * p, size_t /*size*/)
+{
+  free (p);
+}
+
+static void * mmap_anon (size_t size, int flags)
+{
+  void * p = mmap (0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return p == MAP_FAILED ? 0 : p;
+}
+
+// pre-faulted: kernel does page zeroing up front, not inside first test pass
+static void * alloc_populate (size_t size) { return mmap_anon (size, MAP_POPULATE); }
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// explicit hugetlbfs pages: need vm.nr_hugepages (or nr_hugepages of 1G pool) set up
+static void * alloc_hugetlb_2m (size_t size) { return mmap_anon (size, MAP_HUGETLB | MAP_HUGE_2MB | MAP_POPULATE); }
+static void * alloc_hugetlb_1g (size_t size) { return mmap_anon (size, MAP_HUGETLB | MAP_HUGE_1GB | MAP_POPULATE); }
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
 
-    do_memmove((u32 *)buf, size / sizeof (u32), n);
-    do_memmove((u32 *)buf, size / sizeof (u32), n);
-    do_memmove((u32 *)buf, size / sizeof (u32), n);
-    do_memmove((u32 *)buf, size / sizeof (u32), n);
+// transparent huge pages: 2MB aligned mapping + MADV_HUGEPAGE, then pre-fault
+static void * alloc_thp (size_t size)
+{
+  const size_t huge = 2 * 1024 * 1024;
+  char * p = (char *)mmap_anon (size + huge, 0);
+  if (!p)
+    return 0;
+  // trim unaligned head and tail
+  size_t head = (huge - (uintptr_t)p % huge) % huge;
+  if (head)
+    munmap (p, head);
+  munmap (p + head + size, huge - head);
+  p += head;
+  madvise (p, size, MADV_HUGEPAGE);
+  if (madvise (p, size, MADV_POPULATE_WRITE) != 0)
+  {
+    // pre-5.14 kernel: touch every page
+    for (size_t i = 0; i < size; i += 4096)
+      p[i] = 0;
+  }
+  return p;
+}
+
+static void release_munmap (void * p, size_t size)
+{
+  munmap (p, size);
+}
+
+struct allocator
+{
+    const char * name;
+    size_t granule; // buffer sizes are rounded up to it
+    void * (*alloc) (size_t size);
+    void (*release) (void * p, size_t size);
+};
+
+static const allocator allocators[] = {
+    { "malloc",     4096,               alloc_malloc,     release_malloc },
+    { "populate",   4096,               alloc_populate,   release_munmap },
+    { "hugetlb",    2 * 1024 * 1024,    alloc_hugetlb_2m, release_munmap },
+    { "hugetlb-1g", 1024 * 1024 * 1024, alloc_hugetlb_1g, release_munmap },
+    { "thp",        2 * 1024 * 1024,    alloc_thp,        release_munmap },
+};
 
-    free(buf);
+static const allocator * buf_allocator = 0;
+
+static void * alloc_buffer (size_t size)
+{
+  void * p = buf_allocator->alloc (size);
+  if (!p)
+  {
+    fprintf (stderr, "failed to allocate %zu bytes with '%s' allocator: %s\n",
+             size, buf_allocator->name, strerror (errno));
+    exit (1);
+  }
+  return p;
+}
 
-    if (seen_error)
+static void release_buffer (void * p, size_t size)
+{
+  buf_allocator->release (p, size);
+}
+
+static std::atomic<bool> seen_error(false);
+
+// Iterations done by all workers, numbers error reports.
+static std::atomic<size_t> global_iteration(0);
+
+static double now_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Hardware counters around do_memmove() phases (--perf). Each worker
+// opens one perf_event group counting its own thread on any CPU, and
+// phase_now() samples it with a single read(). Uncore IMC counters are
+// system-wide only, so DRAM traffic is taken from offcore 'node' cache
+// events (LLC misses served by local or remote memory). Events the PMU
+// does not have are left out of the group; counts are scaled up when
+// the group had to share counters with other perf users.
+enum { PMU_CYCLES, PMU_INSTRUCTIONS, PMU_LLC_LOAD_MISSES, PMU_LLC_STORE_MISSES,
+       PMU_NODE_LOADS, PMU_NODE_STORES, PMU_EVENTS };
+
+#define PMU_CACHE(cache, op, result) \
+    (PERF_COUNT_HW_CACHE_##cache | PERF_COUNT_HW_CACHE_OP_##op << 8 | PERF_COUNT_HW_CACHE_RESULT_##result << 16)
+
+static const struct
+{
+    const char * name;
+    u32 type;
+    uint64_t config;
+} pmu_events[PMU_EVENTS] = {
+    { "cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "llc_load_misses",  PERF_TYPE_HW_CACHE, PMU_CACHE (LL, READ, MISS) },
+    { "llc_store_misses", PERF_TYPE_HW_CACHE, PMU_CACHE (LL, WRITE, MISS) },
+    { "node_loads",       PERF_TYPE_HW_CACHE, PMU_CACHE (NODE, READ, ACCESS) },
+    { "node_stores",      PERF_TYPE_HW_CACHE, PMU_CACHE (NODE, WRITE, ACCESS) },
+};
+
+#undef PMU_CACHE
+
+struct pmu_group
+{
+    int leader;           // -1: no counters for this thread
+    int slot[PMU_EVENTS]; // position in group read, -1: not counted
+};
+
+static thread_local pmu_group pmu = { -1, {} };
+static std::atomic<bool> pmu_warned(false);
+static std::atomic<size_t> pmu_groups(0); // threads that got counters
+
+static void pmu_open (void)
+{
+  int n = 0;
+  for (int e = 0; e < PMU_EVENTS; e++)
+  {
+    pmu.slot[e] = -1;
+    struct perf_event_attr a;
+    memset (&a, 0, sizeof (a));
+    a.size = sizeof (a);
+    a.type = pmu_events[e].type;
+    a.config = pmu_events[e].config;
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = syscall (SYS_perf_event_open, &a, 0, -1, pmu.leader, 0);
+    if (fd < 0)
+    {
+      if (pmu.leader < 0)
+      {
+        if (!pmu_warned.exchange (true))
+          fprintf (stderr, "perf_event_open(%s) failed: %s, running without counters\n",
+                   pmu_events[e].name, strerror (errno));
+        return;
+      }
+      continue;
+    }
+    if (pmu.leader < 0)
+    {
+      pmu.leader = fd;
+      pmu_groups++;
+    }
+    pmu.slot[e] = n++;
+  }
+}
+
+static inline void pmu_read (uint64_t * counts)
+{
+  struct
+  {
+      uint64_t nr, enabled, running;
+      uint64_t values[PMU_EVENTS];
+  } r;
+  if (pmu.leader < 0 || read (pmu.leader, &r, sizeof (r)) <= 0 || r.running == 0)
+    return;
+  double scale = (double)r.enabled / r.running;
+  for (int e = 0; e < PMU_EVENTS; e++)
+    if (pmu.slot[e] >= 0)
+      counts[e] = r.values[pmu.slot[e]] * scale;
+}
+
+// Per-phase timing of do_memmove(). Throughput dips often show
+// a degraded channel or a throttled host before bit flips do.
+enum { PHASE_FILL, PHASE_MEMMOVE, PHASE_VERIFY, PHASES };
+static const char * const phase_names[PHASES] = { "fill", "memmove", "verify" };
+
+struct phase_sample
+{
+    uint64_t cycles[PHASES]; // TSC ticks (reference cycles)
+    double seconds[PHASES];
+    uint64_t pmu[PHASES][PMU_EVENTS]; // --perf counter deltas, 0 without counters
+    size_t bytes;            // bytes processed by each phase
+    int store;               // store policy of memmove phase
+    size_t streams;          // concurrent store streams of memmove phase
+    size_t errors;           // mismatches found by the pass
+};
+
+struct phase_clock
+{
+    uint64_t tsc;
+    double t;
+    uint64_t pmu[PMU_EVENTS];
+};
+
+static inline phase_clock phase_now (void)
+{
+  phase_clock c = { __rdtsc (), now_seconds (), {} };
+  pmu_read (c.pmu);
+  return c;
+}
+
+static inline void phase_record (phase_sample * ps, int phase, const phase_clock & from, const phase_clock & to)
+{
+  ps->cycles[phase] = to.tsc - from.tsc;
+  ps->seconds[phase] = to.t - from.t;
+  for (int e = 0; e < PMU_EVENTS; e++)
+    ps->pmu[phase][e] = to.pmu[e] - from.pmu[e];
+}
+
+// Picks pattern and fresh key for next pass of this thread: a word the
+// memmove failed to store still holds previous pass' value or fill of the
+// source 'shift' words away, and does not match. Patterns repeating over
+// 'shift' are skipped, seq is the fallback.
+static void next_pattern (size_t iter, size_t shift, int * pattern, u32 * key)
+{
+  static thread_local size_t calls = 0;
+  size_t call = calls++;
+  *pattern = PATTERN_SEQ;
+  for (size_t t = 0; t < patterns.size (); t++)
+    if (pattern_fits (patterns[(call + t) % patterns.size ()], shift))
+    {
+      *pattern = patterns[(call + t) % patterns.size ()];
+      break;
+    }
+  *key = hash32 (hash32 ((u32)iter ^ pattern_seed) + (u32)call);
+}
+
+static size_t do_memmove (u32 * buf, size_t buf_elements, size_t iter, int store, bool upper, bool reread,
+                          phase_sample * ps) __attribute__((noinline));
+static size_t do_memmove (u32 * buf, size_t buf_elements, size_t iter, int store, bool upper, bool reread,
+                          phase_sample * ps)
+{
+  size_t elements_to_move = buf_elements / 2;
+  static thread_local size_t passes = 0;
+  size_t streams = stream_counts[passes++ % stream_counts.size ()];
+  size_t shift = streams > 1 || upper ? elements_to_move : kernel->width / sizeof (u32);
+  int pattern;
+  u32 key;
+  next_pattern (iter, shift, &pattern, &key);
+
+  // Destination is the lower half, except for 'upper' passes that copy
+  // lower half to upper one, so alternating passes make every byte of the
+  // buffer a memmove destination (but first register of a single stream
+  // pass, which moves by minimal offset: one register, 16 bytes for sse2;
+  // NT stores need aligned 'dst'). Streams do not overlap: they come from
+  // upper half.
+  u32 * src = upper || streams == 1 ? buf : buf + elements_to_move;
+  u32 * dst = upper ? buf + elements_to_move : streams > 1 ? buf : buf + shift;
+  size_t len = elements_to_move * sizeof (u32);
+
+  phase_clock c0 = phase_now ();
+  // "memset" buffer with pattern: 0, 1, 2, 3, ... + key for 'seq'
+  widest->fill[pattern] (src, elements_to_move, key);
+
+  // make memmove() read source from DRAM, not from cache lines fill has just written
+  if (opts.verify_dram)
+    flush_range (buf, streams > 1 || upper ? 2 * len : len + kernel->width);
+
+  phase_clock c1 = phase_now ();
+  // __memmove_sse2_unaligned
+  // memmove(dst, buf, elements_to_move * sizeof (u32));
+  if (streams > 1)
+    kernel->run_streams[store](dst, src, len / kernel->width, streams);
+  else
+    kernel->run[store](dst, src, len / kernel->width);
+
+  phase_clock c2 = phase_now ();
+  // validate target buffer buffer with 0, 1, 2, 3, ...
+  verify_ctx ctx = { dst, src, len, iter, kernel->name, store_names[store], pattern, key, (u32)streams };
+  size_t errors;
+  if (opts.verify_dram)
+  {
+    flush_range (dst, len);
+    errors = widest->verify_dram[pattern] (ctx, elements_to_move);
+  }
+  else
+    errors = widest->verify[pattern] (ctx, elements_to_move);
+  phase_clock c3 = phase_now ();
+
+  // second look after a while: catches cells that leak charge
+  // faster than refresh restores it (retention failures)
+  if (reread && opts.reread_delay)
+  {
+    usleep (opts.reread_delay * 1000);
+    flush_range (dst, len);
+    errors += widest->verify_dram[pattern] (ctx, elements_to_move);
+  }
+
+  phase_record (ps, PHASE_FILL, c0, c1);
+  phase_record (ps, PHASE_MEMMOVE, c1, c2);
+  phase_record (ps, PHASE_VERIFY, c2, c3);
+  ps->bytes = elements_to_move * sizeof (u32);
+  ps->store = store;
+  ps->streams = streams;
+
+  if (errors)
+    seen_error = true;
+  return errors;
+}
+
+// Sweep mode (--sweep). Instead of one huge move a pass runs many moves of
+// sizes around points where glibc's __memmove_*_unaligned_erms switches code
+// path, with random misalignment, overlap distance and direction. Moves are
+// batched side by side over the buffer and every size gets an equal share of
+// it, so small sizes get as many bytes moved as the largest one. Even moves
+// go through libc memmove(), odd ones through the test kernel.
+static std::vector<size_t> sweep_sizes;
+
+// Called through a pointer: gcc would expand small memmove()s inline.
+static void * (* volatile libc_memmove) (void *, const void *, size_t) = memmove;
+
+// Numeric glibc tunable from GLIBC_TUNABLES, 0 if not set.
+static size_t glibc_tunable (const char * name)
+{
+  const char * t = getenv ("GLIBC_TUNABLES");
+  const char * p = t ? strstr (t, name) : 0;
+  if (!p || p[strlen (name)] != '=')
+    return 0;
+  return strtoull (p + strlen (name) + 1, 0, 0);
+}
+
+// Sizes around glibc's dispatch points (sysdeps/x86/dl-cacheinfo.h and
+// memmove-vec-unaligned-erms.S) up to 'max_size'.
+static void init_sweep_sizes (size_t max_size)
+{
+  // 1, 2-3, 4-7, 8-15, 16-31 byte and 1, 2, 4, 8 VEC_SIZE cases for all vector sizes
+  std::vector<size_t> points = { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 4096 };
+  // rep movsb: 2048 * (VEC_SIZE / 16) by default
+  if (size_t t = glibc_tunable ("glibc.cpu.x86_rep_movsb_threshold"))
+    points.push_back (t);
+  else
+    points.insert (points.end (), { 2048, 4096, 8192 });
+  // non-temporal stores: 3/4 of per-thread L3 share in older glibc, 1/4 of
+  // L3 in newer; 4x unrolled loop at 16 times that
+  std::vector<size_t> nt;
+  if (size_t t = glibc_tunable ("glibc.cpu.x86_non_temporal_threshold"))
+    nt.push_back (t);
+  else if (long l3 = sysconf (_SC_LEVEL3_CACHE_SIZE); l3 > 0)
+    nt.insert (nt.end (), { (size_t)l3 / 4, (size_t)l3 * 3 / 4 / std::max (1L, sysconf (_SC_NPROCESSORS_ONLN)),
+                            (size_t)l3 * 3 / 4 });
+  for (size_t t : nt)
+    points.insert (points.end (), { t, t * 16 });
+
+  for (size_t p : points)
+    for (size_t s : { p - 1, p, p + 1 })
+      if (s > 0 && s <= max_size)
+        sweep_sizes.push_back (s);
+  std::sort (sweep_sizes.begin (), sweep_sizes.end ());
+  sweep_sizes.erase (std::unique (sweep_sizes.begin (), sweep_sizes.end ()), sweep_sizes.end ());
+
+  fprintf (stderr, "sweep: %zu sizes from %zu to %zu bytes", sweep_sizes.size (), sweep_sizes.front (), sweep_sizes.back ());
+  for (size_t t : nt)
+    fprintf (stderr, "%s%zu", t == nt.front () ? ", non-temporal threshold candidates: " : ", ", t);
+  fprintf (stderr, "%s\n", !nt.empty () && nt.back () * 16 > max_size ? " (raise -s to cover 4x loop)" : "");
+}
+
+struct sweep_move
+{
+    size_t slot, end; // [slot, end): bytes owned by the move, with guards
+    size_t dst, src, len;
+    bool libc;
+};
+
+// Places move of 'size' bytes at 'pos'. 'h' picks misalignment, distance
+// between src and dst (overlapping or not) and direction.
+static sweep_move sweep_case (size_t pos, size_t size, u32 h, bool libc)
+{
+  // short distances hit word and vector boundary handling of overlaps
+  static const size_t near[] = { 1, 3, 4, 15, 16, 17, 31, 32, 33, 63, 64, 65 };
+  const size_t width = kernel->width;
+  const size_t guard = 64;
+  size_t align = h % 64;
+  bool overlap = (h >> 6) & 1;
+  bool backward = (h >> 7) & 1; // dst above src
+  size_t dist = overlap ? ((h >> 8) & 1 ? near[(h >> 9) % 12] : 1 + (h >> 13) % size)
+                        : size + (h >> 8) % 64;
+
+  sweep_move m;
+  m.slot = pos;
+  m.libc = libc;
+  m.len = size;
+  size_t lo = pos + guard;
+  if (libc)
+  {
+    m.src = backward ? lo + align : lo + align + dist;
+    m.dst = backward ? lo + align + dist : lo + align;
+  }
+  else
+  {
+    // kernels move blocks of 8 registers to aligned 'dst' and copy
+    // backwards: dst below src is only valid without overlap
+    m.len = std::max (8 * width, size & ~(8 * width - 1));
+    if (backward)
+    {
+      m.src = lo + align;
+      m.dst = (m.src + dist + width - 1) & ~(width - 1);
+    }
+    else
+    {
+      m.dst = (lo + width - 1) & ~(width - 1);
+      m.src = m.dst + std::max (dist, m.len) + align;
+    }
+  }
+  m.end = (std::max (m.src, m.dst) + m.len + guard + 63) & ~(size_t)63;
+  return m;
+}
+
+// Slow path of sweep_check(): queues mismatching words of 'n' bytes at 'a'
+// (expected bytes at 'e').
+static size_t report_sweep_mismatches (const verify_ctx & ctx, const char * a, const char * e, size_t n) __attribute__((noinline, cold));
+static size_t report_sweep_mismatches (const verify_ctx & ctx, const char * a, const char * e, size_t n)
+{
+  size_t errors = 0;
+  for (size_t i = 0; i < n; )
+  {
+    if (a[i] == e[i])
+    {
+      i++;
+      continue;
+    }
+    // whole aligned word around mismatching byte, bytes out of [a, a + n) are taken as is
+    const char * w = (const char *)((uintptr_t)(a + i) & ~(uintptr_t)3);
+    u32 actual, expected;
+    memcpy (&actual, w, sizeof (u32));
+    memcpy (&expected, w, sizeof (u32));
+    for (size_t k = 0; k < sizeof (u32); k++)
+      if (w + k >= a && w + k < a + n)
+        ((char *)&expected)[k] = e[w + k - a];
+    thread_error_ring->push (error_record { (const u32 *)w, ctx.dst, ctx.src, ctx.len, ctx.iter, expected, actual, ctx.kernel, ctx.store, ctx.streams, 0 });
+    errors++;
+    i = w + sizeof (u32) - a;
+  }
+  return errors;
+}
+
+// Checks 'n' bytes at base + at hold pattern bytes of offset 'from' as
+// written by fill.
+static size_t sweep_check (const verify_ctx & ctx, const char * base, size_t at, size_t from, size_t n)
+{
+  u32 window[1024 + 1];
+  size_t errors = 0;
+  while (n)
+  {
+    size_t part = std::min (n, sizeof (window) - sizeof (u32));
+    for (size_t j = 0; j < (from % 4 + part + 3) / 4; j++)
+      window[j] = pattern_word (ctx.pattern, ctx.key, from / 4 + j);
+    const char * e = (const char *)window + from % 4;
+    if (__builtin_expect (memcmp (base + at, e, part) != 0, 0))
+      errors += report_sweep_mismatches (ctx, base + at, e, part);
+    at += part;
+    from += part;
+    n -= part;
+  }
+  return errors;
+}
+
+static size_t do_sweep (u32 * buf, size_t buf_elements, size_t iter, int store, bool upper, phase_sample * ps) __attribute__((noinline));
+static size_t do_sweep (u32 * buf, size_t buf_elements, size_t iter, int store, bool upper, phase_sample * ps)
+{
+  int pattern;
+  u32 key;
+  next_pattern (iter, SIZE_MAX, &pattern, &key);
+  size_t region = buf_elements / 2 * sizeof (u32);
+  char * base = (char *)buf + (upper ? region : 0);
+
+  static thread_local std::vector<sweep_move> moves;
+  static std::atomic<bool> warned(false);
+  moves.clear ();
+  size_t pos = 0, moved = 0;
+  u32 n = 0;
+  for (size_t k = 0; k < sweep_sizes.size (); ++k)
+  {
+    // k-th size owns k-th share of the region, but gets at least one move
+    size_t limit = region / sweep_sizes.size () * (k + 1);
+    size_t first = moves.size ();
+    for (;;)
+    {
+      sweep_move m = sweep_case (pos, sweep_sizes[k], hash32 (key ^ hash32 (n)), n % 2 == 0);
+      if (m.end > region || (m.end > limit && moves.size () > first))
+        break;
+      moves.push_back (m);
+      pos = m.end;
+      n++;
+    }
+    if (moves.size () == first && !warned.exchange (true))
+      fprintf (stderr, "sweep: no room for moves of %zu bytes and larger in %zu byte region\n",
+               sweep_sizes[k], region);
+  }
+  if (moves.empty ())
+    return 0;
+  size_t used = moves.back ().end;
+
+  phase_clock c0 = phase_now ();
+  widest->fill[pattern] ((u32 *)base, (used + sizeof (u32) - 1) / sizeof (u32), key);
+  if (opts.verify_dram)
+    flush_range (base, used);
+
+  phase_clock c1 = phase_now ();
+  for (auto & m : moves)
+  {
+    if (m.libc)
+      libc_memmove (base + m.dst, base + m.src, m.len);
+    else
+      kernel->run[store](base + m.dst, base + m.src, m.len / kernel->width);
+    moved += m.len;
+  }
+
+  phase_clock c2 = phase_now ();
+  if (opts.verify_dram)
+    flush_range (base, used);
+  size_t errors = 0;
+  for (auto & m : moves)
+  {
+    verify_ctx ctx = { (u32 const *)(base + m.dst), (u32 const *)(base + m.src), m.len, iter,
+                       m.libc ? "libc" : kernel->name, m.libc ? "memmove" : store_names[store], pattern, key, 1 };
+    errors += sweep_check (ctx, base, m.slot, m.slot, m.dst - m.slot);
+    errors += sweep_check (ctx, base, m.dst, m.src, m.len);
+    errors += sweep_check (ctx, base, m.dst + m.len, m.dst + m.len, m.end - m.dst - m.len);
+  }
+  phase_clock c3 = phase_now ();
+
+  phase_record (ps, PHASE_FILL, c0, c1);
+  phase_record (ps, PHASE_MEMMOVE, c1, c2);
+  phase_record (ps, PHASE_VERIFY, c2, c3);
+  ps->bytes = moved;
+  ps->store = store;
+  ps->streams = 1;
+
+  if (errors)
+    seen_error = true;
+  return errors;
+}
+
+// Persistent run journal (--journal). Append-only log in a mmap()ed file,
+// so what the test learned survives a crash or reboot of a host with bad
+// RAM. Appends are plain memory writes: space is reserved with an atomic
+// add on header's 'used', record's 'size' is stored first and 'type' last
+// to commit it. Space past 'used' is always zero, so a crash between
+// reservation and 'size' store leaves zero words replay can step over,
+// and committed records after a torn one are not lost. Main thread
+// msync()s the journal once per stats interval. --resume replays it to
+// continue counters, iteration numbers and error index.
+enum { JREC_ITERATION = 1, JREC_ERROR, JREC_REGION, JREC_PERF };
+
+struct journal_header
+{
+    char magic[8];     // "XMMJRNL1"
+    uint64_t size;     // file size
+    uint64_t used;     // bytes of record area reserved so far (may exceed capacity)
+    uint64_t runs;     // number of times journal was (re)opened
+};
+
+struct jrec_header
+{
+    u32 type; // 0: not committed yet
+    u32 size; // whole record with header, 8-byte aligned; 0: not written yet
+};
+
+// worker iteration done
+struct jrec_iteration
+{
+    uint64_t iter, worker, bytes, errors;
+    double time; // seconds since first run started
+};
+
+// one do_memmove() pass with --perf: counters next to its throughput and errors
+struct jrec_perf
+{
+    uint64_t iter, worker, bytes, errors;
+    u32 store, streams;
+    double seconds[PHASES];
+    uint64_t counts[PHASES][PMU_EVENTS];
+};
+
+struct jrec_error
+{
+    uint64_t phys; // 0: unknown
+    uint64_t iter;
+    u32 expected, actual;
+};
+
+// physical memory range held and tested by this run; a JREC_REGION
+// record carries as many of them as fit its size
+struct jrec_region
+{
+    uint64_t phys, size;
+};
+
+static journal_header * journal = 0;
+static char * journal_data = 0;  // record area
+static size_t journal_capacity = 0;
+static std::atomic<bool> journal_full(false);
+
+// Carried over from previous runs by --resume.
+static struct
+{
+    size_t iterations, bytes, errors;
+    double time;
+} resumed = { 0, 0, 0, 0 };
+
+// Physical memory held by previous and current run: start -> end of
+// disjoint, non-adjacent ranges, and their total size.
+static std::map<uint64_t, uint64_t> phys_regions;
+static size_t phys_regions_bytes = 0;
+static std::mutex phys_regions_lock;
+
+static double run_start = 0; // now_seconds() at start, minus resumed time
+
+static void journal_append (u32 type, const void * payload, size_t size)
+{
+  if (!journal)
+    return;
+  size_t total = (sizeof (jrec_header) + size + 7) & ~(size_t)7;
+  uint64_t off = __atomic_fetch_add (&journal->used, total, __ATOMIC_RELAXED);
+  if (off + total > journal_capacity)
+  {
+    if (!journal_full.exchange (true))
+      fprintf (stderr, "journal is full, further records are lost\n");
+    return;
+  }
+  jrec_header * r = (jrec_header *)(journal_data + off);
+  __atomic_store_n (&r->size, (u32)total, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  memcpy (r + 1, payload, size);
+  __atomic_store_n (&r->type, type, __ATOMIC_RELEASE);
+}
+
+// Merges 'r' into phys_regions. Returns false if it was covered already.
+// Caller holds phys_regions_lock.
+static bool add_phys_region (const jrec_region & r)
+{
+  uint64_t first = r.phys, last = r.phys + r.size;
+  auto it = phys_regions.upper_bound (first);
+  if (it != phys_regions.begin () && std::prev (it)->second >= first)
+    --it;
+  if (it != phys_regions.end () && it->first <= first && it->second >= last)
+    return false;
+  while (it != phys_regions.end () && it->first <= last)
+  {
+    first = std::min (first, it->first);
+    last = std::max (last, it->second);
+    phys_regions_bytes -= it->second - it->first;
+    it = phys_regions.erase (it);
+  }
+  phys_regions[first] = last;
+  phys_regions_bytes += last - first;
+  return true;
+}
+
+// Journals physical extents of [p, p + size), coalescing adjacent pages.
+// Extents already known (memory of a freed chunk taken again) are not
+// journaled twice; new ones go out in as few records as possible.
+// Needs root, like any pagemap lookup.
+static void journal_regions (const void * p, size_t size)
+{
+  if (!journal || pagemap_fd < 0)
+    return;
+  std::vector<jrec_region> runs;
+  jrec_region run = { 0, 0 };
+  for (size_t off = 0; off < size; off += page_size)
+  {
+    uint64_t phys;
+    if (!virt_to_phys ((const char *)p + off, &phys))
+      continue;
+    if (run.size && run.phys + run.size == phys)
+    {
+      run.size += page_size;
+      continue;
+    }
+    if (run.size)
+      runs.push_back (run);
+    run.phys = phys;
+    run.size = page_size;
+  }
+  if (run.size)
+    runs.push_back (run);
+
+  std::vector<jrec_region> fresh;
+  {
+    std::lock_guard<std::mutex> guard(phys_regions_lock);
+    for (auto & x : runs)
+      if (add_phys_region (x))
+        fresh.push_back (x);
+  }
+  const size_t per_record = 4096;
+  for (size_t i = 0; i < fresh.size (); i += per_record)
+    journal_append (JREC_REGION, &fresh[i], std::min (per_record, fresh.size () - i) * sizeof (jrec_region));
+}
+
+// Distinct physical memory held by all runs recorded in journal.
+static size_t phys_covered (void)
+{
+  std::lock_guard<std::mutex> guard(phys_regions_lock);
+  return phys_regions_bytes;
+}
+
+// Offset of first record at or after 'off', stepping over zero words of
+// space a crash left reserved but unwritten.
+static uint64_t journal_skip_torn (uint64_t off, uint64_t limit)
+{
+  while (off + sizeof (jrec_header) <= limit && *(const uint64_t *)(journal_data + off) == 0)
+    off += 8;
+  return off;
+}
+
+// Returns end of last committed record: appends of this run go there.
+static uint64_t journal_replay (void)
+{
+  size_t max_iter = 0;
+  bool any_iter = false;
+  uint64_t limit = std::min (journal->used, (uint64_t)journal_capacity), end = 0;
+  for (uint64_t off = journal_skip_torn (0, limit); off + sizeof (jrec_header) <= limit;
+       off = journal_skip_torn (off, limit))
+  {
+    jrec_header * r = (jrec_header *)(journal_data + off);
+    if (r->size < sizeof (jrec_header) || r->size % 8 || off + r->size > limit)
+      break; // garbage, not a record: nothing after it can be trusted
+    const void * payload = r + 1;
+    u32 type = __atomic_load_n (&r->type, __ATOMIC_ACQUIRE);
+    switch (type)
+    {
+      case JREC_ITERATION:
+      {
+        const jrec_iteration * it = (const jrec_iteration *)payload;
+        resumed.iterations++;
+        resumed.bytes += it->bytes;
+        resumed.errors += it->errors;
+        resumed.time = std::max (resumed.time, it->time);
+        max_iter = std::max (max_iter, (size_t)it->iter);
+        any_iter = true;
+        break;
+      }
+      case JREC_ERROR:
+      {
+        // virtual addresses of old runs are meaningless: only physical ones
+        const jrec_error * e = (const jrec_error *)payload;
+        if (e->phys)
+          index_error_at (e->phys, true, e->expected ^ e->actual, e->iter);
+        break;
+      }
+      case JREC_REGION:
+        for (size_t i = 0; i < (r->size - sizeof (jrec_header)) / sizeof (jrec_region); i++)
+          add_phys_region (((const jrec_region *)payload)[i]);
+        break;
+    }
+    // type 0: torn record, 'size' says how far to skip
+    off += r->size;
+    if (type)
+      end = off;
+  }
+  if (any_iter)
+    global_iteration = max_iter + 1;
+  return end;
+}
+
+static void journal_open (const char * path, size_t size, bool resume)
+{
+  int fd = open (path, O_RDWR | O_CREAT, 0644);
+  struct stat st;
+  if (fd < 0 || fstat (fd, &st) != 0)
+  {
+    fprintf (stderr, "failed to open journal '%s': %s\n", path, strerror (errno));
+    exit (1);
+  }
+  bool existing = resume && (size_t)st.st_size > sizeof (journal_header);
+  if (existing)
+    size = st.st_size;
+  else if (ftruncate (fd, 0) != 0 || ftruncate (fd, size) != 0)
+  {
+    fprintf (stderr, "failed to size journal '%s': %s\n", path, strerror (errno));
+    exit (1);
+  }
+  void * p = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (p == MAP_FAILED)
+  {
+    fprintf (stderr, "failed to map journal '%s': %s\n", path, strerror (errno));
+    exit (1);
+  }
+  journal = (journal_header *)p;
+  journal_data = (char *)p + sizeof (journal_header);
+  journal_capacity = size - sizeof (journal_header);
+
+  if (existing)
+  {
+    if (memcmp (journal->magic, "XMMJRNL1", 8) != 0 || journal->size != size)
+    {
+      fprintf (stderr, "'%s' is not a journal\n", path);
+      exit (1);
+    }
+    // continue right after last record that was completely written; zero
+    // everything past it, not just up to 'used': a crash can leave 'used'
+    // behind records that made it to disk. Only pages with data are
+    // written, holes of the sparse file stay holes
+    uint64_t end = journal_replay ();
+    for (uint64_t off = end; off < journal_capacity; )
+    {
+      uint64_t next = std::min ((off / page_size + 1) * page_size, (uint64_t)journal_capacity);
+      const uint64_t * w = (const uint64_t *)(journal_data + off);
+      const uint64_t * w_end = (const uint64_t *)(journal_data + next);
+      while (w < w_end && !*w)
+        w++;
+      if (w < w_end)
+        memset (journal_data + off, 0, next - off);
+      off = next;
+    }
+    journal->used = end;
+    journal->runs++;
+    fprintf (stderr, "resumed journal '%s': run %zu, %zu iterations, %.1fGB tested, %zu errors, %.0fs,"
+             " %.1fGB of physical memory covered\n",
+             path, (size_t)journal->runs, resumed.iterations, resumed.bytes / 1e9, resumed.errors,
+             resumed.time, phys_covered () / 1e9);
+  }
+  else
+  {
+    memcpy (journal->magic, "XMMJRNL1", 8);
+    journal->size = size;
+    journal->used = 0;
+    journal->runs = 1;
+  }
+  msync (journal, size, MS_SYNC);
+}
+
+static void journal_sync (void)
+{
+  if (!journal)
+    return;
+  size_t used = std::min ((size_t)journal->used, journal_capacity);
+  msync (journal, sizeof (journal_header) + used, MS_SYNC);
+}
+
+// Memory held by the test. Chunks are filled with '!' and stay that way
+// between memmove tests, so idle chunks can be rechecked for decay.
+// With --checksum they hold a keyed pattern instead and carry a checksum
+// per 4KiB block taken right after the fill.
+struct stash_chunk
+{
+    void * ptr;
+    size_t size;
+    int node;           // NUMA node memory is bound to, -1: not bound
+    size_t last_tested; // global iteration of last memmove test + 1, 0: never
+    size_t tests;       // memmove tests of the whole chunk (both halves) done
+    bool busy;          // a worker is using it right now
+    int pattern;        // --checksum: fill pattern and key of the chunk
+    u32 key;
+    std::vector<u32> sums; // --checksum: block_sum() of each stash_block
+    bool keep;          // --focus retested errors here: never given back
+};
+
+static std::vector<stash_chunk *> ram_stash;
+static std::mutex ram_stash_lock;
+static size_t recheck_cursor = 0; // round-robin position of fill rechecks
+
+static const unsigned char stash_fill = '!';
+static const size_t stash_block = 4096;
+
+// CRC32C of a stash_block as 4 independent chains over its quarters.
+// A single chain is latency bound (8 bytes per 3 cycles), four keep up
+// with memory bandwidth. Any bit flip changes exactly one chain's CRC,
+// chains are folded with distinct rotations so the sum changes too.
+// crc32 is SSE4.2: --checksum checks the CPU has it, callers carry the target.
+static inline u32 block_sum (const uint64_t * p) __attribute__((always_inline, target("sse4.2")));
+static inline u32 block_sum (const uint64_t * p)
+{
+  const size_t q = stash_block / 4 / sizeof (uint64_t);
+  uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+  for (size_t i = 0; i < q; i++)
+  {
+    c0 = _mm_crc32_u64 (c0, p[i]);
+    c1 = _mm_crc32_u64 (c1, p[i + q]);
+    c2 = _mm_crc32_u64 (c2, p[i + 2 * q]);
+    c3 = _mm_crc32_u64 (c3, p[i + 3 * q]);
+  }
+  u32 s1 = (u32)c1, s2 = (u32)c2, s3 = (u32)c3;
+  return (u32)c0 ^ (s1 << 8 | s1 >> 24) ^ (s2 << 16 | s2 >> 16) ^ (s3 << 24 | s3 >> 8);
+}
+
+static void index_sums (stash_chunk * c) __attribute__((noinline, target("sse4.2")));
+static void index_sums (stash_chunk * c)
+{
+  c->sums.resize (c->size / stash_block);
+  for (size_t b = 0; b < c->sums.size (); b++)
+    c->sums[b] = block_sum ((const uint64_t *)((const char *)c->ptr + b * stash_block));
+}
+
+// Refills chunk after it was allocated or memmove-tested. With --checksum
+// a fresh pattern goes in and the block index is rebuilt from memory
+// (a store that did not make it to DRAM shows up on next recheck).
+static void fill_chunk (stash_chunk * c, size_t iter)
+{
+  if (!opts.checksum)
+  {
+    memset(c->ptr, stash_fill, c->size);
+    return;
+  }
+  next_pattern (iter, 0, &c->pattern, &c->key);
+  widest->fill[c->pattern] ((u32 *)c->ptr, c->size / sizeof (u32), c->key);
+  index_sums (c);
+}
+
+// Caller's memory policy decides placement, 'node' only labels the chunk.
+// Returns false if allocator is out of memory (e.g. hugetlb pool is empty).
+static bool take_ram(int node)
+{
+    size_t size = opts.chunk_size;
+    void * chunk = buf_allocator->alloc(size);
+    if (!chunk)
+        return false;
+    stash_chunk * c = new stash_chunk { chunk, size, node, 0, 0, false, 0, 0, {}, false };
+    fill_chunk(c, global_iteration);
+    journal_regions(chunk, size);
+    std::lock_guard<std::mutex> guard(ram_stash_lock);
+    ram_stash.push_back(c);
+    return true;
+}
+
+// Frees at least 'bytes' of stash (if there is that much), newest chunks first.
+// Chunks being tested right now and --focus ones are skipped. Returns freed amount.
+static size_t free_ram(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(ram_stash_lock);
+    size_t freed = 0;
+    for (size_t i = ram_stash.size(); i > 0 && freed < bytes; --i)
+    {
+        stash_chunk * c = ram_stash[i - 1];
+        if (c->busy || c->keep)
+            continue;
+        freed += c->size;
+        release_buffer (c->ptr, c->size);
+        delete c;
+        ram_stash.erase(ram_stash.begin() + (i - 1));
+    }
+    recheck_cursor = 0;
+    return freed;
+}
+
+// Least recently memmove-tested idle chunk on 'node' (-1: any), marked busy. 0 if none.
+static stash_chunk * checkout_lru_chunk (int node)
+{
+  std::lock_guard<std::mutex> guard(ram_stash_lock);
+  stash_chunk * lru = 0;
+  for (auto c : ram_stash)
+    if (!c->busy && (node < 0 || c->node == node) && (!lru || c->last_tested < lru->last_tested))
+      lru = c;
+  if (lru)
+    lru->busy = true;
+  return lru;
+}
+
+// Next idle chunk on 'node' (-1: any) in round-robin order, marked busy. 0 if none.
+static stash_chunk * checkout_recheck_chunk (int node)
+{
+  std::lock_guard<std::mutex> guard(ram_stash_lock);
+  for (size_t n = 0; n < ram_stash.size (); ++n)
+  {
+    stash_chunk * c = ram_stash[recheck_cursor++ % ram_stash.size ()];
+    if (!c->busy && (node < 0 || c->node == node))
+    {
+      c->busy = true;
+      return c;
+    }
+  }
+  return 0;
+}
+
+// tested: iteration + 1 of memmove test just done on the chunk, 0: none.
+// Test counters are read by stats under the lock, so update them here.
+static void checkin_chunk (stash_chunk * c, size_t tested)
+{
+  std::lock_guard<std::mutex> guard(ram_stash_lock);
+  if (tested)
+  {
+    c->last_tested = tested;
+    c->tests++;
+  }
+  c->busy = false;
+}
+
+static size_t report_fill_mismatches (const stash_chunk * c, size_t first, size_t count, size_t iter) __attribute__((noinline, cold));
+// 'first' and 'count' are in bytes, multiples of u32. Mismatches are
+// reported per u32 word to match memmove errors, 'iter': global iteration
+// the check ran in.
+static size_t report_fill_mismatches (const stash_chunk * c, size_t first, size_t count, size_t iter)
+{
+  const u32 * p = (const u32 *)c->ptr;
+  size_t errors = 0;
+  for (size_t i = first / sizeof (u32); i < (first + count) / sizeof (u32); i++)
+  {
+    u32 v = p[i];
+    u32 e = opts.checksum ? pattern_word (c->pattern, c->key, i) : 0x01010101u * stash_fill;
+    if (v != e)
+    {
+      thread_error_ring->push (error_record { p + i, c->ptr, 0, c->size, iter, e, v, 0, 0, 0, 0 });
+      errors++;
+    }
+  }
+  return errors;
+}
+
+// --checksum recheck: rehash blocks and compare with the index, words are
+// diffed only in blocks whose sum changed. A block that hashes wrong but
+// diffs clean had a transient read error and is not counted.
+static size_t check_sums (const stash_chunk * c, size_t iter) __attribute__((noinline, target("sse4.2")));
+static size_t check_sums (const stash_chunk * c, size_t iter)
+{
+  size_t errors = 0;
+  for (size_t b = 0; b < c->sums.size (); b++)
+    if (__builtin_expect (block_sum ((const uint64_t *)((const char *)c->ptr + b * stash_block)) != c->sums[b], 0))
+      errors += report_fill_mismatches (c, b * stash_block, stash_block, iter);
+  size_t tail = c->sums.size () * stash_block;
+  if (tail < c->size)
+    errors += report_fill_mismatches (c, tail, c->size - tail, iter);
+  return errors;
+}
+
+// Cheap read-only check of an idle chunk: is it still all '!' (or, with
+// --checksum, do its blocks still match the index)?
+// 4 loads are folded into one compare to keep it at read bandwidth.
+static size_t check_fill (const stash_chunk * c, size_t iter) __attribute__((noinline));
+static size_t check_fill (const stash_chunk * c, size_t iter)
+{
+  if (opts.checksum)
+    return check_sums (c, iter);
+  const __m128i * p = (const __m128i *)c->ptr;
+  const __m128i e = _mm_set1_epi8 ((char)stash_fill);
+  const size_t step = 4 * sizeof (__m128i);
+  size_t errors = 0;
+  size_t i = 0;
+  for (; i + step <= c->size; i += step, p += 4)
+  {
+    __m128i m = _mm_and_si128 (_mm_and_si128 (_mm_cmpeq_epi8 (_mm_load_si128 (p + 0), e),
+                                              _mm_cmpeq_epi8 (_mm_load_si128 (p + 1), e)),
+                               _mm_and_si128 (_mm_cmpeq_epi8 (_mm_load_si128 (p + 2), e),
+                                              _mm_cmpeq_epi8 (_mm_load_si128 (p + 3), e)));
+    if (__builtin_expect (_mm_movemask_epi8 (m) != 0xFFFF, 0))
+      errors += report_fill_mismatches (c, i, step, iter);
+  }
+  if (i < c->size)
+    errors += report_fill_mismatches (c, i, c->size - i, iter);
+  return errors;
+}
+
+// NUMA topology from sysfs. Memory placement uses raw set_mempolicy()
+// to avoid libnuma dependency.
+struct numa_node
+{
+    int id;
+    std::vector<int> cpus; // CPUs of the node we are allowed to run on
+};
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+// "0-3,8-11" -> { 0, 1, 2, 3, 8, 9, 10, 11 }
+static std::vector<int> parse_cpulist (const char * s)
+{
+  std::vector<int> r;
+  while (*s && *s != '\n')
+  {
+    char * end;
+    long first = strtol (s, &end, 10);
+    if (end == s)
+      break;
+    long last = first;
+    if (*end == '-')
+      last = strtol (end + 1, &end, 10);
+    for (long c = first; c <= last; ++c)
+      r.push_back (c);
+    s = end;
+    if (*s == ',')
+      s++;
+  }
+  return r;
+}
+
+static std::vector<numa_node> discover_numa_nodes (const cpu_set_t & allowed)
+{
+  std::vector<numa_node> nodes;
+  DIR * d = opendir ("/sys/devices/system/node");
+  if (!d)
+    return nodes;
+  while (struct dirent * e = readdir (d))
+  {
+    int id;
+    if (sscanf (e->d_name, "node%d", &id) != 1)
+      continue;
+    char path[128];
+    snprintf (path, sizeof (path), "/sys/devices/system/node/node%d/cpulist", id);
+    FILE * f = fopen (path, "r");
+    if (!f)
+      continue;
+    char line[4096] = "";
+    if (!fgets (line, sizeof (line), f))
+      line[0] = '\0';
+    fclose (f);
+    numa_node n { id, {} };
+    for (int cpu : parse_cpulist (line))
+      if (cpu < CPU_SETSIZE && CPU_ISSET (cpu, &allowed))
+        n.cpus.push_back (cpu);
+    nodes.push_back (n);
+  }
+  closedir (d);
+  std::sort (nodes.begin (), nodes.end (), [] (const numa_node & a, const numa_node & b) { return a.id < b.id; });
+  return nodes;
+}
+
+// Binds all further allocations of calling thread to 'node'.
+static bool bind_memory_to_node (int node)
+{
+  unsigned long mask[16] = { 0 };
+  const size_t bits = 8 * sizeof (mask[0]);
+  if (node < 0 || (size_t)node >= bits * 16)
+    return false;
+  mask[node / bits] |= 1UL << (node % bits);
+  return syscall (SYS_set_mempolicy, MPOL_BIND, mask, bits * 16 + 1) == 0;
+}
+
+// Per-thread state. Counters are written by owning worker
+// and only read by main thread for aggregated stats.
+struct alignas(64) worker
+{
+    size_t id;
+    int cpu; // -1 if not pinned
+    int node; // NUMA node of 'cpu', -1 without --numa
+    int mem_node; // NUMA node buffers are bound to, -1 without --numa
+    std::thread thread;
+
+    std::atomic<size_t> iterations{0};
+    std::atomic<size_t> bytes_tested{0};
+    std::atomic<size_t> bytes_rechecked{0}; // stash fill rechecks
+    std::atomic<size_t> errors{0};
+
+    // do_memmove() timings since last stats line, taken by main thread
+    std::mutex samples_lock;
+    std::vector<phase_sample> samples;
+
+    error_ring errors_found; // drained by reporter thread
+};
+
+// Runs do_memmove() and keeps its timing for stats.
+// 'reread': this pass does the --reread-delay check of the iteration.
+static size_t timed_memmove (worker * w, u32 * buf, size_t buf_elements, size_t iter, int store, bool upper,
+                             bool reread = false)
+{
+  phase_sample ps;
+  size_t errors = opts.sweep ? do_sweep (buf, buf_elements, iter, store, upper, &ps)
+                             : do_memmove (buf, buf_elements, iter, store, upper, reread, &ps);
+  ps.errors = errors;
+  store_bytes[store].fetch_add (ps.bytes, std::memory_order_relaxed);
+  store_errors[store].fetch_add (errors, std::memory_order_relaxed);
+  if (opts.perf)
+  {
+    jrec_perf rec = { iter, w->id, ps.bytes, errors, (u32)store, (u32)ps.streams, {}, {} };
+    memcpy (rec.seconds, ps.seconds, sizeof (rec.seconds));
+    memcpy (rec.counts, ps.pmu, sizeof (rec.counts));
+    journal_append (JREC_PERF, &rec, sizeof (rec));
+  }
+  std::lock_guard<std::mutex> guard(w->samples_lock);
+  w->samples.push_back (ps);
+  return errors;
+}
+
+// Focused retest (--focus). After a pass finds errors the worker stays on a
+// small window around the latest bad word for a while, mlock()s it and
+// moves data within it over and over with rotating patterns, store
+// policies, destination distance (1-8 registers) and source misalignment
+// (every word offset of a register). Reproduction rate of the window and
+// of the bad word itself characterizes a flaky cell in seconds. Each page
+// is focused on once; errors found are reported like any other and added
+// to '*errors'. Returns false if no window was retested: bad word is not in
+// 'buf', its page was focused on before or 'buf' is smaller than a window.
+// 'unlock': munlock() the window when done. Windows of kept stash chunks
+// stay locked, so the bad page stays resident; scratch buffer windows are
+// unlocked unless the worker holds the whole buffer locked anyway.
+static const size_t focus_window = 64 * 1024;
+static std::set<uintptr_t> focused_pages;
+static std::mutex focused_pages_lock;
+
+static bool focus_retest (worker * w, void * buf, size_t size, size_t iter, bool unlock, size_t * errors_out)
+{
+  const u32 * bad = w->errors_found.last_addr;
+  char * b = (char *)buf;
+  if (!bad || (char *)bad < b || (char *)bad >= b + size || size < focus_window)
+    return false;
+  {
+    std::lock_guard<std::mutex> guard(focused_pages_lock);
+    if (!focused_pages.insert ((uintptr_t)bad / page_size).second)
+      return false;
+  }
+  size_t from = ((char *)bad - b) / page_size * page_size;
+  from = std::min (from - std::min (from, focus_window / 2), size - focus_window);
+  char * base = b + from;
+  bool locked = mlock (base, focus_window) == 0;
+  if (!locked)
+    fprintf (stderr, "focus: worker %zu: failed to mlock() %zuKiB window at %p: %s, retesting it unlocked\n",
+             w->id, focus_window / 1024, (void *)base, strerror (errno));
+
+  const size_t width = kernel->width;
+  const size_t len = (focus_window - 9 * width) & ~(8 * width - 1);
+  const size_t np = store_policies.size ();
+  size_t passes = 0, reproduced = 0, same_word = 0, errors = 0;
+  double t0 = now_seconds (), t = t0;
+  for (; t - t0 < opts.focus; t = now_seconds (), passes++)
+  {
+    int store = store_policies[passes % np];
+    u32 * src = (u32 *)(base + passes / 8 % (width / sizeof (u32)) * sizeof (u32));
+    u32 * dst = (u32 *)(base + (1 + passes % 8) * width);
+    size_t elements = len / sizeof (u32);
+    int pattern;
+    u32 key;
+    next_pattern (iter, dst - src, &pattern, &key);
+
+    widest->fill[pattern] (src, elements, key);
+    if (opts.verify_dram)
+      flush_range (src, len);
+    kernel->run[store] (dst, src, len / width);
+    verify_ctx ctx = { dst, src, len, iter, kernel->name, store_names[store], pattern, key, 1 };
+    size_t e;
+    if (opts.verify_dram)
+    {
+      flush_range (dst, len);
+      e = widest->verify_dram[pattern] (ctx, elements);
+    }
+    else
+      e = widest->verify[pattern] (ctx, elements);
+    size_t i = bad - dst;
+    if (bad >= dst && i < elements && dst[i] != pattern_word (pattern, key, i))
+      same_word++;
+    reproduced += e != 0;
+    errors += e;
+  }
+
+  if (locked && unlock)
+    munlock (base, focus_window);
+
+  uint64_t phys = 0;
+  virt_to_phys (bad, &phys);
+  double rate = passes ? 100.0 * reproduced / passes : 0;
+  if (opts.json)
+    printf ("{\"type\":\"focus\",\"worker\":%zu,\"addr\":\"%p\",\"phys\":%llu,\"window_bytes\":%zu,\"passes\":%zu,"
+            "\"reproduced\":%zu,\"same_word\":%zu,\"errors\":%zu,\"seconds\":%.3f}\n",
+            w->id, (const void *)bad, (unsigned long long)phys, focus_window, passes, reproduced, same_word, errors, t - t0);
+  else
+    fprintf (stderr, "focus: worker %zu addr=%p phys=%#llx window=%zuKiB passes=%zu reproduced=%zu (%.2f%%)"
+             " same_word=%zu errors=%zu in %.1fs\n",
+             w->id, (const void *)bad, (unsigned long long)phys, focus_window / 1024, passes, reproduced, rate,
+             same_word, errors, t - t0);
+  *errors_out += errors;
+  return true;
+}
+
+static void worker_loop (worker * w)
+{
+  if (w->cpu >= 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (w->cpu, &set);
+    int r = pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+    if (r != 0)
+      fprintf (stderr, "worker %zu: failed to pin to cpu %d: %s\n", w->id, w->cpu, strerror (r));
+  }
+  thread_error_ring = &w->errors_found;
+  if (opts.perf)
+    pmu_open ();
+
+  // Thread memory policy covers scratch buffer and stash chunks this
+  // worker allocates, including pages pre-faulted by MAP_POPULATE.
+  if (w->mem_node >= 0 && !bind_memory_to_node (w->mem_node))
+    fprintf (stderr, "worker %zu: failed to bind memory to node %d: %s\n", w->id, w->mem_node, strerror (errno));
+
+  // Scratch buffer is allocated once and reused: no page faults,
+  // kernel page zeroing or TLB refills in the middle of test passes.
+  // Page aligned: widest kernel needs 64-byte aligned 'dst'.
+  size_t size = opts.chunk_size;
+  void * buf = alloc_buffer (size);
+  bool buf_locked = mlock (buf, size) == 0;
+  journal_regions (buf, size);
+
+  for (;;)
+  {
+    size_t n = global_iteration++;
+    // wait for a failure
+
+    // A/B mode: consecutive passes over the same buffer use different store policies
+    const size_t np = store_policies.size ();
+    size_t errors = 0;
+    // and odd passes write the upper half of the buffer
+    errors += timed_memmove(w, (u32 *)buf, size / sizeof (u32), n, store_policies[(4 * n + 0) % np], false);
+    errors += timed_memmove(w, (u32 *)buf, size / sizeof (u32), n, store_policies[(4 * n + 1) % np], true);
+    errors += timed_memmove(w, (u32 *)buf, size / sizeof (u32), n, store_policies[(4 * n + 2) % np], false);
+    errors += timed_memmove(w, (u32 *)buf, size / sizeof (u32), n, store_policies[(4 * n + 3) % np], true, true);
+    if (errors && opts.focus)
+      focus_retest (w, buf, size, n, !buf_locked, &errors);
+
+    // each do_memmove() writes half of the buffer: lower, upper, lower, upper
+    size_t tested = 4 * (size / 2);
+
+    // rotate memmove test over held memory, least recently tested first
+    if (stash_chunk * c = checkout_lru_chunk (w->mem_node))
+    {
+      // lower and upper half as destination, so one test covers the whole chunk
+      size_t e = timed_memmove(w, (u32 *)c->ptr, c->size / sizeof (u32), n, store_policies[n % np], false);
+      e += timed_memmove(w, (u32 *)c->ptr, c->size / sizeof (u32), n, store_policies[(n + 1) % np], true);
+      // a chunk with a focused error is kept: its window stays locked
+      if (e && opts.focus && focus_retest (w, c->ptr, c->size, n, false, &e))
+        c->keep = true;
+      errors += e;
+      fill_chunk(c, n);
+      tested += c->size;
+      checkin_chunk (c, n + 1);
+    }
+
+    // and recheck another idle chunk did not decay since last fill
+    if (stash_chunk * c = checkout_recheck_chunk (w->mem_node))
+    {
+      size_t e = check_fill (c, n);
+      w->bytes_rechecked.fetch_add (c->size, std::memory_order_relaxed);
+      if (e && opts.focus && focus_retest (w, c->ptr, c->size, n, false, &e))
+      {
+        c->keep = true;
+        fill_chunk(c, n);
+      }
+      errors += e;
+      checkin_chunk (c, 0);
+    }
+    if (errors)
+      seen_error = true;
+
+    w->bytes_tested.fetch_add (tested, std::memory_order_relaxed);
+    w->errors.fetch_add (errors, std::memory_order_relaxed);
+    w->iterations.fetch_add (1, std::memory_order_relaxed);
+
+    jrec_iteration rec = { n, w->id, tested, errors, now_seconds () - run_start };
+    journal_append (JREC_ITERATION, &rec, sizeof (rec));
+  }
+}
+
+// Background verifier (--verifier): rechecks idle stash chunks back to
+// back instead of one per worker iteration, so memory that only sits in
+// the stash is read many times a minute. Unpinned, any node.
+static error_ring verifier_errors;
+static std::atomic<size_t> verifier_bytes(0);
+static std::atomic<size_t> verifier_found(0);
+
+static void verifier_loop (void)
+{
+  thread_error_ring = &verifier_errors;
+  for (;;)
+  {
+    stash_chunk * c = checkout_recheck_chunk (-1);
+    if (!c)
+    {
+      usleep (100 * 1000);
+      continue;
+    }
+    // runs alongside workers: iteration next one of them starts
+    size_t errors = check_fill (c, global_iteration.load (std::memory_order_relaxed));
+    verifier_bytes.fetch_add (c->size, std::memory_order_relaxed);
+    checkin_chunk (c, 0);
+    if (errors)
+    {
+      seen_error = true;
+      verifier_found.fetch_add (errors, std::memory_order_relaxed);
+    }
+  }
+}
+
+// Background memory load (--load). Some failures only show up when the
+// memory controller is saturated by other work, so these threads stream
+// over buffers of their own next to the checking workers: 'read' only
+// loads, 'write' only does NT stores, 'copy' does both. A thread with a
+// target bandwidth sleeps whenever it gets ahead of schedule.
+enum { LOAD_READ, LOAD_WRITE, LOAD_COPY, LOAD_KINDS };
+static const char * const load_names[LOAD_KINDS] = { "read", "write", "copy" };
+
+struct alignas(64) load_gen
+{
+    int kind;
+    double target; // GB/s, 0: as fast as it goes
+    int cpu;       // -1: not pinned
+    std::thread thread;
+    std::atomic<size_t> bytes; // read plus written
+};
+
+// Another hardware thread of the core 'cpu' is on, -1 if there is none.
+static int smt_sibling (int cpu)
+{
+  char path[128];
+  snprintf (path, sizeof (path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+  FILE * f = fopen (path, "r");
+  if (!f)
+    return -1;
+  char line[256];
+  int sibling = -1;
+  if (fgets (line, sizeof (line), f))
+    for (int c : parse_cpulist (line))
+      if (c != cpu)
+      {
+        sibling = c;
+        break;
+      }
+  fclose (f);
+  return sibling;
+}
+
+static void load_loop (load_gen * g)
+{
+  if (g->cpu >= 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (g->cpu, &set);
+    int r = pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+    if (r != 0)
+      fprintf (stderr, "load %s: failed to pin to cpu %d: %s\n", load_names[g->kind], g->cpu, strerror (r));
+  }
+
+  // copy: first half to second half
+  size_t size = opts.load_size;
+  __m128i * buf = (__m128i *)alloc_buffer (size);
+  size_t items = size / sizeof (__m128i) / (g->kind == LOAD_COPY ? 2 : 1);
+  const size_t block = 1024 * 1024 / sizeof (__m128i);
+  __m128i sum = _mm_setzero_si128 ();
+  __m128i v = _mm_set1_epi8 ('L');
+  // read and copy loads read what they never wrote: back every page with
+  // memory of its own first, or untouched pages of --alloc=malloc all map
+  // the shared zero page and reads are served from cache
+  memset (buf, 'L', size);
+
+  double start = now_seconds ();
+  size_t done = 0;
+  for (;;)
+  {
+    for (size_t i = 0; i < items; i += block)
+    {
+      size_t n = std::min (block, items - i);
+      switch (g->kind)
+      {
+        case LOAD_READ:
+          for (size_t j = i; j < i + n; j++)
+            sum = _mm_xor_si128 (sum, _mm_load_si128 (buf + j));
+          break;
+        case LOAD_WRITE:
+          for (size_t j = i; j < i + n; j++)
+            _mm_stream_si128 (buf + j, v);
+          break;
+        case LOAD_COPY:
+          for (size_t j = i; j < i + n; j++)
+            _mm_stream_si128 (buf + items + j, _mm_load_si128 (buf + j));
+          break;
+      }
+      size_t bytes = n * sizeof (__m128i) * (g->kind == LOAD_COPY ? 2 : 1);
+      g->bytes.fetch_add (bytes, std::memory_order_relaxed);
+      done += bytes;
+      if (g->target > 0)
+      {
+        double ahead = done / (g->target * 1e9) - (now_seconds () - start);
+        if (ahead > 0.001)
+          usleep (ahead * 1e6);
+      }
+    }
+    _mm_sfence ();
+    // keep reads from being optimized away
+    __asm__ __volatile__ ("" : : "x" (sum));
+  }
+}
+
+// Memory pressure control. Instead of eating RAM until OOM killer comes
+// (and kills neighbours on shared hosts) stash grows in large steps while
+// more than --headroom of memory is available, holds there and gives
+// chunks back when available memory drops below half of headroom.
+
+// MemAvailable from /proc/meminfo, in bytes. Also returns MemTotal.
+static size_t meminfo_available (size_t * total)
+{
+  FILE * f = fopen ("/proc/meminfo", "r");
+  size_t avail = 0;
+  if (total)
+    *total = 0;
+  if (!f)
+    return 0;
+  char line[256];
+  while (fgets (line, sizeof (line), f))
+  {
+    unsigned long long kb;
+    if (sscanf (line, "MemAvailable: %llu kB", &kb) == 1)
+      avail = kb * 1024;
+    else if (total && sscanf (line, "MemTotal: %llu kB", &kb) == 1)
+      *total = kb * 1024;
+  }
+  fclose (f);
+  return avail;
+}
+
+// Smallest memory.max - memory.current over our cgroup v2 and its ancestors.
+// Returns false if no cgroup limit is set.
+static bool cgroup_available (size_t * avail)
+{
+  FILE * f = fopen ("/proc/self/cgroup", "r");
+  if (!f)
+    return false;
+  char line[4096];
+  std::string path;
+  while (fgets (line, sizeof (line), f))
+    if (strncmp (line, "0::", 3) == 0)
+    {
+      path = line + 3;
+      if (!path.empty () && path.back () == '\n')
+        path.pop_back ();
+    }
+  fclose (f);
+
+  bool limited = false;
+  for (;;)
+  {
+    std::string dir = "/sys/fs/cgroup" + path;
+    unsigned long long max, current;
+    FILE * fm = fopen ((dir + "/memory.max").c_str (), "r");
+    FILE * fc = fopen ((dir + "/memory.current").c_str (), "r");
+    if (fm && fc && fscanf (fm, "%llu", &max) == 1 && fscanf (fc, "%llu", &current) == 1)
+    {
+      size_t a = max > current ? max - current : 0;
+      if (!limited || a < *avail)
+        *avail = a;
+      limited = true;
+    }
+    if (fm) fclose (fm);
+    if (fc) fclose (fc);
+    if (path.empty () || path == "/")
+      break;
+    path.erase (path.rfind ('/'));
+  }
+  return limited;
+}
+
+static size_t available_memory (void)
+{
+  size_t avail = meminfo_available (0);
+  size_t cg;
+  if (cgroup_available (&cg) && cg < avail)
+    avail = cg;
+  return avail;
+}
+
+// Set once stash stopped growing for any reason: headroom reached, memory
+// pressure, or growth stopped by an error. Never cleared: chunks added
+// later start with 0 tests and hold pass coverage back by themselves.
+static std::atomic<bool> stash_settled(false);
+
+// 'nodes': NUMA nodes to spread stash over round-robin (-1: no binding).
+static void pressure_loop (std::vector<int> nodes)
+{
+  size_t next_node = 0;
+  bool alloc_failed = false;
+  for (;;)
+  {
+    size_t avail = available_memory ();
+    if (avail < opts.headroom / 2)
+    {
+      stash_settled = true;
+      size_t freed = free_ram (opts.headroom - avail);
+      if (freed)
+      {
+        fprintf (stderr, "memory pressure: available=%zuMB, released %zuMB of stash\n",
+                 avail >> 20, freed >> 20);
+        // MemAvailable is folded from per-CPU counters about once a second:
+        // let it catch up before next decision
+        sleep (1);
+      }
+      else
+        usleep (100 * 1000);
+      continue;
+    }
+    // after first error stash stops growing: keep memory layout stable
+    // and so it does once allocator ran out of memory before headroom did
+    if (!seen_error && !alloc_failed && avail > opts.headroom + opts.chunk_size)
+    {
+      size_t chunks = std::min (avail - opts.headroom, opts.grow_step) / opts.chunk_size;
+      chunks = std::max (chunks, (size_t)1);
+      fprintf (stderr, "alloc more: %zu\n", chunks * opts.chunk_size);
+      for (size_t i = 0; i < chunks; ++i)
+      {
+        int node = nodes[next_node++ % nodes.size ()];
+        if (node >= 0)
+          bind_memory_to_node (node);
+        if (!take_ram (node))
+        {
+          fprintf (stderr, "failed to allocate %zu bytes of stash with '%s' allocator: %s, "
+                   "stash stops growing\n", opts.chunk_size, buf_allocator->name, strerror (errno));
+          alloc_failed = true;
+          break;
+        }
+      }
+      sleep (1);
+      continue;
+    }
+    stash_settled = true;
+    usleep (100 * 1000);
+  }
+}
+
+// Live stats page (--shm). A fixed layout block in /dev/shm/NAME that a
+// monitoring agent can mmap() and poll without talking to the test. Main
+// thread is the only writer and refreshes it every 100ms; workers never
+// touch it. Seqlock protocol for readers:
+//   do { s = seq (acquire); copy block; (acquire fence) } while (s & 1 || s != seq);
+static const size_t shm_masks = 16;
+
+struct shm_stats
+{
+    char magic[8];             // "XMMSTAT1"
+    u32 size;                  // sizeof (shm_stats)
+    u32 pid;
+    uint64_t seq;              // odd while block is being written
+    double time;               // seconds since run started (with --resume: first run)
+    double rate_gbps;          // tested bytes per second over last second
+    uint64_t iterations;
+    uint64_t tested_bytes;
+    uint64_t rechecked_bytes;
+    uint64_t errors;
+    uint64_t stash_chunks;
+    uint64_t stash_bytes;
+    uint64_t stash_passes;     // passes all stash chunks went through
+    char kernel[16];           // memmove kernel name
+    char store_names[STORE_POLICIES][16];
+    uint64_t store_bytes[STORE_POLICIES];  // memmove bytes per kernel store policy
+    uint64_t store_errors[STORE_POLICIES];
+    uint64_t bit_errors[32];   // mismatches per flipped bit position
+    struct
+    {
+        u32 mask;              // expected ^ actual, 0: unused slot
+        u32 pad;
+        uint64_t count;
+    } masks[shm_masks];        // most frequent bit_mismatch values
+};
+
+// Filled by reporter thread for every error, including suppressed ones.
+static std::map<u32, size_t> mask_errors;
+static std::mutex mask_errors_lock;
+
+static void count_error_mask (u32 mask)
+{
+  std::lock_guard<std::mutex> guard(mask_errors_lock);
+  mask_errors[mask]++;
+}
+
+// Reporter thread: drains worker error rings, attributes errors to physical
+// pages, dedups repeated (address, bit mask) hits and rate limits output.
+// Each (address, bit mask) site is printed on hits 1, 2, 4, 8, ... while
+// rate budget allows; the rest are summarized once a second.
+static FILE * error_log = 0;
+
+static void emit_error (const error_record & r, uint64_t phys, size_t count, size_t total)
+{
+  u32 e = r.expected, v = r.actual;
+  size_t offset = r.addr - (const u32 *)r.base;
+  const char * source = r.kernel ? "memmove" : "fill";
+  // --streams: which of the concurrently written parts the word is in,
+  // -1: the tail that does not split evenly, copied after all streams
+  size_t streams = std::max (r.streams, 1u);
+  size_t part = r.len / streams / 64 * 64;
+  long stream = streams == 1 ? 0 : offset * sizeof (u32) < streams * part ? (long)(offset * sizeof (u32) / part) : -1;
+  char stream_info[48] = "";
+  if (stream < 0)
+    snprintf (stream_info, sizeof (stream_info), "; stream=tail/%zu", streams);
+  else if (streams > 1)
+    snprintf (stream_info, sizeof (stream_info), "; stream=%ld/%zu", stream, streams);
+  switch (opts.error_format[0])
+  {
+    case 'j':
+      fprintf (error_log,
+               "{\"type\":\"error\",\"source\":\"%s\",\"addr\":\"%p\",\"phys\":\"%#llx\",\"offset\":%zu,"
+               "\"expected\":\"%08X\",\"actual\":\"%08X\",\"bit_mismatch\":\"%08X\",\"iteration\":%zu,"
+               "\"kernel\":\"%s\",\"store\":\"%s\",\"stream\":%ld,\"streams\":%zu,\"count\":%zu,\"total\":%zu}\n",
+               source, (const void *)r.addr, (unsigned long long)phys, offset, e, v, v^e, r.iter,
+               r.kernel ? r.kernel : "", r.store ? r.store : "", stream, streams, count, total);
+      break;
+    case 'c':
+      fprintf (error_log, "%s,%p,%#llx,%zu,%08X,%08X,%08X,%zu,%s,%s,%ld,%zu,%zu,%zu\n",
+               source, (const void *)r.addr, (unsigned long long)phys, offset, e, v, v^e, r.iter,
+               r.kernel ? r.kernel : "", r.store ? r.store : "", stream, streams, count, total);
+      break;
+    default:
+      if (r.kernel)
+        fprintf (error_log,
+                 "Bad result in memmove(dst=%p, src=%p, len=%zd)"
+                 ": offset=%8zu; expected=%08X(%8u) actual=%08X(%8u) bit_mismatch=%08X; iteration=%zu; kernel=%s/%s%s; phys=%#llx; count=%zu\n",
+                 r.base, r.src, r.len,
+                 offset, e, e, v, v, v^e, r.iter, r.kernel, r.store, stream_info, (unsigned long long)phys, count);
+      else
+        fprintf (error_log,
+                 "Bad stash fill(chunk=%p, len=%zu)"
+                 ": offset=%9zu; expected=%08X actual=%08X bit_mismatch=%08X; iteration=%zu; phys=%#llx; count=%zu\n",
+                 r.base, r.len, offset * sizeof (u32), e, v, v^e, r.iter, (unsigned long long)phys, count);
+      break;
+  }
+}
+
+static void reporter_loop (std::vector<error_ring *> rings)
+{
+  // (address, bit mask) -> hits. Two generations bound memory on hosts
+  // with millions of bad words: once 'sites' fills up it becomes 'old_sites'
+  // and sites not hit again before the next turn are forgotten.
+  typedef std::map<std::pair<const u32 *, u32>, size_t> site_map;
+  site_map sites, old_sites;
+  const size_t max_sites = 1 << 16;
+  size_t total = 0, budget = opts.error_rate, suppressed = 0, dropped = 0;
+  double window = now_seconds ();
+
+  if (opts.error_format[0] == 'c')
+    fprintf (error_log, "source,addr,phys,offset,expected,actual,bit_mismatch,iteration,kernel,store,stream,streams,count,total\n");
+
+  for (;;)
+  {
+    bool idle = true;
+    for (auto ring : rings)
+    {
+      error_record r;
+      while (ring->pop (&r))
+      {
+        idle = false;
+        total++;
+        u32 mask = r.expected ^ r.actual;
+        count_error_mask (mask);
+        uint64_t phys = r.phys;
+        index_error (r.addr, phys, mask, r.iter);
+        auto key = std::make_pair (r.addr, mask);
+        auto site = sites.find (key);
+        if (site == sites.end ())
+        {
+          auto old = old_sites.find (key);
+          site = sites.insert (std::make_pair (key, old != old_sites.end () ? old->second : 0)).first;
+          if (old != old_sites.end ())
+            old_sites.erase (old);
+        }
+        size_t count = ++site->second;
+        if (sites.size () >= max_sites)
+        {
+          old_sites.swap (sites);
+          sites.clear ();
+        }
+        if ((count & (count - 1)) == 0)
+        {
+          jrec_error rec = { phys, r.iter, r.expected, r.actual };
+          journal_append (JREC_ERROR, &rec, sizeof (rec));
+        }
+        if (budget > 0 && (count & (count - 1)) == 0)
+        {
+          emit_error (r, phys, count, total);
+          budget--;
+        }
+        else
+          suppressed++;
+      }
+    }
+
+    double now = now_seconds ();
+    if (now - window >= 1.0)
+    {
+      size_t d = 0;
+      for (auto ring : rings)
+        d += ring->dropped.load (std::memory_order_relaxed);
+      if (suppressed || d != dropped)
+      {
+        if (opts.error_format[0] == 't')
+          fprintf (error_log, "errors: %zu lines suppressed, %zu records dropped (ring full); %zu distinct sites, %zu total\n",
+                   suppressed, d - dropped, sites.size () + old_sites.size (), total);
+        else if (opts.error_format[0] == 'j')
+          fprintf (error_log, "{\"type\":\"error_summary\",\"suppressed\":%zu,\"dropped\":%zu,\"sites\":%zu,\"total\":%zu}\n",
+                   suppressed, d - dropped, sites.size () + old_sites.size (), total);
+      }
+      fflush (error_log);
+      suppressed = 0;
+      dropped = d;
+      budget = opts.error_rate;
+      window = now;
+    }
+    if (idle)
+      usleep (10 * 1000);
+  }
+}
+
+// Previous print_stats() sample, to compute rates.
+struct stats_state
+{
+    double last_time;
+    size_t last_bytes;
+    std::map<int, size_t> last_node_bytes;
+    size_t last_load_bytes[LOAD_KINDS];
+    size_t last_errors;
+    // total bandwidth bucket (GB/s / 2) -> (seconds, errors)
+    std::map<int, std::pair<double, size_t>> by_bandwidth;
+};
+
+// Bandwidth of --load threads and how error rate depends on total
+// (test + load) bandwidth over the run.
+static void print_load_stats (std::vector<load_gen> & loads, double dt, double test_rate, size_t errors, stats_state & st)
+{
+  size_t bytes[LOAD_KINDS] = { 0, 0, 0 };
+  for (auto & g : loads)
+    bytes[g.kind] += g.bytes.load (std::memory_order_relaxed);
+  double rate[LOAD_KINDS], total = test_rate;
+  for (int k = 0; k < LOAD_KINDS; k++)
+  {
+    rate[k] = dt > 0 ? (bytes[k] - st.last_load_bytes[k]) / dt / 1e9 : 0;
+    total += rate[k];
+    st.last_load_bytes[k] = bytes[k];
+  }
+  size_t new_errors = errors - st.last_errors;
+  st.last_errors = errors;
+  auto & b = st.by_bandwidth[(int)(total / 2)];
+  b.first += dt;
+  b.second += new_errors;
+
+  if (opts.json)
+    printf ("{\"type\":\"load\",\"read_gbps\":%.3f,\"write_gbps\":%.3f,\"copy_gbps\":%.3f,\"total_gbps\":%.3f,\"errors\":%zu}\n",
+            rate[LOAD_READ], rate[LOAD_WRITE], rate[LOAD_COPY], total, new_errors);
+  else
+    fprintf (stderr, "  load: read=%.2fGB/s write=%.2fGB/s copy=%.2fGB/s total(with test)=%.2fGB/s errors=%zu\n",
+             rate[LOAD_READ], rate[LOAD_WRITE], rate[LOAD_COPY], total, new_errors);
+  if (!errors)
+    return;
+  for (auto & i : st.by_bandwidth)
+  {
+    double per_hour = i.second.first > 0 ? i.second.second * 3600 / i.second.first : 0;
+    if (opts.json)
+      printf ("{\"type\":\"errors_by_bandwidth\",\"min_gbps\":%d,\"max_gbps\":%d,\"seconds\":%.0f,\"errors\":%zu,\"errors_per_hour\":%.1f}\n",
+              i.first * 2, i.first * 2 + 2, i.second.first, i.second.second, per_hour);
+    else
+      fprintf (stderr, "    total %3d-%3dGB/s: %6.0fs errors=%zu (%.1f/h)\n",
+               i.first * 2, i.first * 2 + 2, i.second.first, i.second.second, per_hour);
+  }
+}
+
+// Bandwidth and errors per memory node: a failing memory
+// controller or socket shows up as a single bad line.
+static void print_node_stats (std::vector<worker> & workers, double dt, stats_state & st)
+{
+  std::map<int, std::pair<size_t, size_t>> nodes; // mem node -> (bytes, errors)
+  std::map<int, size_t> threads;
+  for (auto & w : workers)
+  {
+    auto & n = nodes[w.mem_node];
+    n.first += w.bytes_tested.load (std::memory_order_relaxed);
+    n.second += w.errors.load (std::memory_order_relaxed);
+    threads[w.mem_node]++;
+  }
+  std::map<int, size_t> stash_bytes;
+  {
+    std::lock_guard<std::mutex> guard(ram_stash_lock);
+    for (auto c : ram_stash)
+      stash_bytes[c->node] += c->size;
+  }
+  for (auto & n : nodes)
+  {
+    size_t bytes = n.second.first;
+    double rate = dt > 0 ? (bytes - st.last_node_bytes[n.first]) / dt / 1e9 : 0;
+    if (opts.json)
+      printf ("{\"type\":\"node\",\"node\":%d,\"threads\":%zu,\"tested_bytes\":%zu,\"rate_gbps\":%.3f,"
+              "\"stash_bytes\":%zu,\"errors\":%zu}\n",
+              n.first, threads[n.first], bytes, rate, stash_bytes[n.first], n.second.second);
+    else
+      fprintf (stderr, "  node%d: threads=%zu tested=%.1fGB rate=%.2fGB/s stash=%.1fGB errors=%zu\n",
+               n.first, threads[n.first], bytes / 1e9, rate,
+               stash_bytes[n.first] / 1e9, n.second.second);
+    st.last_node_bytes[n.first] = bytes;
+  }
+}
+
+// --perf counters per phase: over passes since last stats line, and over
+// the whole run split into passes that found errors and clean ones, to see
+// whether failing passes saw different traffic. Events per KiB moved.
+struct pmu_totals
+{
+    size_t passes;
+    double bytes;
+    uint64_t counts[PMU_EVENTS];
+};
+
+static void print_pmu_line (const char * scope, int phase, const pmu_totals & t)
+{
+  if (!t.passes)
+    return;
+  double kib = t.bytes / 1024;
+  double ipc = t.counts[PMU_CYCLES] ? (double)t.counts[PMU_INSTRUCTIONS] / t.counts[PMU_CYCLES] : 0;
+  if (opts.json)
+  {
+    printf ("{\"type\":\"perf\",\"scope\":\"%s\",\"phase\":\"%s\",\"passes\":%zu,\"bytes\":%.0f",
+            scope, phase_names[phase], t.passes, t.bytes);
+    for (int e = 0; e < PMU_EVENTS; e++)
+      printf (",\"%s\":%llu", pmu_events[e].name, (unsigned long long)t.counts[e]);
+    printf ("}\n");
+    return;
+  }
+  fprintf (stderr, "  perf %-7s %-8s passes=%zu ipc=%.2f", phase_names[phase], scope, t.passes, ipc);
+  for (int e = PMU_LLC_LOAD_MISSES; e < PMU_EVENTS; e++)
+    fprintf (stderr, " %s/KiB=%.2f", pmu_events[e].name, kib ? t.counts[e] / kib : 0);
+  fprintf (stderr, "\n");
+}
+
+static void print_pmu_stats (const std::vector<phase_sample> & samples)
+{
+  static pmu_totals clean[PHASES], failing[PHASES];
+  for (int phase = 0; phase < PHASES; ++phase)
+  {
+    pmu_totals interval = {};
+    for (auto & ps : samples)
+    {
+      pmu_totals & run = ps.errors ? failing[phase] : clean[phase];
+      for (pmu_totals * t : { &interval, &run })
+      {
+        t->passes++;
+        t->bytes += ps.bytes;
+        for (int e = 0; e < PMU_EVENTS; e++)
+          t->counts[e] += ps.pmu[phase][e];
+      }
+    }
+    print_pmu_line ("interval", phase, interval);
+    if (failing[phase].passes)
+    {
+      print_pmu_line ("clean", phase, clean[phase]);
+      print_pmu_line ("failing", phase, failing[phase]);
+    }
+  }
+}
+
+// min/median/max GB/s over do_memmove() calls since last stats line
+// and average TSC cycles per byte, per phase.
+static void print_phase_stats (std::vector<worker> & workers)
+{
+  std::vector<phase_sample> samples;
+  for (auto & w : workers)
+  {
+    std::lock_guard<std::mutex> guard(w.samples_lock);
+    samples.insert (samples.end (), w.samples.begin (), w.samples.end ());
+    w.samples.clear ();
+  }
+  if (samples.empty ())
+    return;
+  // all zeros when perf_event_open() failed everywhere: nothing to print
+  if (opts.perf && pmu_groups.load (std::memory_order_relaxed))
+    print_pmu_stats (samples);
+
+  // in A/B mode phases are split by store policy, and by stream count with --streams
+  bool split_streams = stream_counts.size () > 1 || stream_counts[0] > 1;
+  for (int store : store_policies)
+  for (size_t streams : stream_counts)
+  for (int phase = 0; phase < PHASES; ++phase)
+  {
+    std::vector<double> rates;
+    double cycles = 0, bytes = 0;
+    for (auto & ps : samples)
+    {
+      if (ps.store != store || ps.streams != streams)
+        continue;
+      if (ps.seconds[phase] > 0)
+        rates.push_back (ps.bytes / ps.seconds[phase] / 1e9);
+      cycles += ps.cycles[phase];
+      bytes += ps.bytes;
+    }
+    if (rates.empty ())
+      continue;
+    std::sort (rates.begin (), rates.end ());
+    double cpb = bytes ? cycles / bytes : 0;
+    if (opts.json)
+      printf ("{\"type\":\"phase\",\"phase\":\"%s\",\"store\":\"%s\",\"streams\":%zu,\"samples\":%zu,\"min_gbps\":%.3f,"
+              "\"median_gbps\":%.3f,\"max_gbps\":%.3f,\"cycles_per_byte\":%.4f}\n",
+              phase_names[phase], store_names[store], streams, rates.size (), rates.front (), rates[rates.size () / 2], rates.back (), cpb);
+    else
+    {
+      char split[32] = "";
+      if (split_streams)
+        snprintf (split, sizeof (split), " streams=%zu", streams);
+      fprintf (stderr, "  %-7s: store=%s%s samples=%zu GB/s min=%.2f median=%.2f max=%.2f cycles/byte=%.3f\n",
+               phase_names[phase], store_names[store], split, rates.size (), rates.front (), rates[rates.size () / 2], rates.back (), cpb);
+    }
+  }
+  if (store_policies.size () > 1)
+  {
+    for (int store : store_policies)
+    {
+      size_t bytes = store_bytes[store].load (std::memory_order_relaxed);
+      size_t errors = store_errors[store].load (std::memory_order_relaxed);
+      if (opts.json)
+        printf ("{\"type\":\"store\",\"store\":\"%s\",\"tested_bytes\":%zu,\"errors\":%zu}\n",
+                store_names[store], bytes, errors);
+      else
+        fprintf (stderr, "  store %s: tested=%.1fGB errors=%zu\n", store_names[store], bytes / 1e9, errors);
+    }
+  }
+}
+
+// Memory held by the test and how many times all of it was a memmove
+// destination: a lower half pass and the upper half pass after it write
+// the whole buffer, once per stash chunk test and twice per scratch
+// iteration. Sweep moves do not cover their region: 0 passes.
+struct coverage
+{
+    size_t chunks, stash_bytes, stash_passes;
+    size_t held_bytes, passes;
+};
+
+static coverage get_coverage (std::vector<worker> & workers)
+{
+  coverage cv = { 0, 0, 0, 0, 0 };
+  {
+    std::lock_guard<std::mutex> guard(ram_stash_lock);
+    for (auto c : ram_stash)
+    {
+      cv.stash_passes = cv.chunks ? std::min (cv.stash_passes, c->tests) : c->tests;
+      cv.chunks++;
+      cv.stash_bytes += c->size;
+    }
+  }
+  cv.passes = cv.chunks ? cv.stash_passes : SIZE_MAX;
+  for (auto & w : workers)
+    cv.passes = std::min (cv.passes, 2 * w.iterations.load (std::memory_order_relaxed));
+  if (opts.sweep)
+    cv.passes = 0;
+  cv.held_bytes = cv.stash_bytes + workers.size () * opts.chunk_size;
+  return cv;
+}
+
+static void print_stats (std::vector<worker> & workers, std::vector<load_gen> & loads, double elapsed, stats_state & st)
+{
+  size_t iterations = resumed.iterations, bytes = resumed.bytes, rechecked = 0, errors = resumed.errors;
+  for (auto & w : workers)
+  {
+    iterations += w.iterations.load (std::memory_order_relaxed);
+    bytes += w.bytes_tested.load (std::memory_order_relaxed);
+    rechecked += w.bytes_rechecked.load (std::memory_order_relaxed);
+    errors += w.errors.load (std::memory_order_relaxed);
+  }
+  rechecked += verifier_bytes.load (std::memory_order_relaxed);
+  errors += verifier_found.load (std::memory_order_relaxed);
+  // stash_passes: every held chunk went through at least that many memmove tests
+  coverage cv = get_coverage (workers);
+  size_t stash = cv.chunks, stash_bytes = cv.stash_bytes, stash_passes = cv.stash_passes;
+  double dt = elapsed - st.last_time;
+  double rate = dt > 0 ? (bytes - st.last_bytes) / dt / 1e9 : 0;
+  if (opts.json)
+    printf ("{\"type\":\"stats\",\"time\":%.3f,\"threads\":%zu,\"iterations\":%zu,\"tested_bytes\":%zu,"
+            "\"rate_gbps\":%.3f,\"stash_chunks\":%zu,\"stash_bytes\":%zu,\"stash_passes\":%zu,"
+            "\"rechecked_bytes\":%zu,\"available_bytes\":%zu,\"errors\":%zu}\n",
+            elapsed, workers.size (), iterations, bytes, rate,
+            stash, stash_bytes, stash_passes, rechecked, available_memory (), errors);
+  else
+    fprintf (stderr,
+             "stats: time=%.0fs threads=%zu iterations=%zu tested=%.1fGB rate=%.2fGB/s"
+             " stash=%zu(%.1fGB) stash_passes=%zu rechecked=%.1fGB avail=%.1fGB errors=%zu\n",
+             elapsed, workers.size (), iterations, bytes / 1e9, rate,
+             stash, stash_bytes / 1e9, stash_passes, rechecked / 1e9, available_memory () / 1e9, errors);
+  print_phase_stats (workers);
+  if (opts.numa)
+    print_node_stats (workers, dt, st);
+  if (!loads.empty ())
+    print_load_stats (loads, dt, rate, errors, st);
+  if (journal)
+  {
+    size_t used = std::min ((size_t)journal->used, journal_capacity);
+    if (opts.json)
+      printf ("{\"type\":\"journal\",\"used_bytes\":%zu,\"capacity_bytes\":%zu,\"phys_covered_bytes\":%zu}\n",
+              used, journal_capacity, phys_covered ());
+    else
+      fprintf (stderr, "  journal: used=%.1fMB of %.1fMB phys_covered=%.1fGB\n",
+               used / 1e6, journal_capacity / 1e6, phys_covered () / 1e9);
+  }
+  if (opts.json)
+    fflush (stdout);
+  st.last_bytes = bytes;
+  st.last_time = elapsed;
+  if (errors)
+    print_error_summary ();
+}
+
+// Bounded runs (--passes, --time, --bytes): reason the run is over, 0 to go on.
+// Pass coverage only counts once stash stopped growing, so chunks still to
+// come cannot be skipped.
+static const char * run_done (std::vector<worker> & workers, double elapsed)
+{
+  if (opts.time && elapsed >= opts.time)
+    return "time";
+  if (opts.bytes)
+  {
+    size_t bytes = 0;
+    for (auto & w : workers)
+      bytes += w.bytes_tested.load (std::memory_order_relaxed);
+    if (bytes >= opts.bytes)
+      return "bytes";
+  }
+  if (opts.passes && stash_settled && get_coverage (workers).passes >= opts.passes)
+    return "passes";
+  return 0;
+}
+
+// Errors of resumed runs fail this one too, but leave seen_error alone:
+// it would stop stash from growing over memory this run has not held yet.
+static bool run_failed ()
+{
+  return seen_error || resumed.errors;
+}
+
+static void print_run_summary (std::vector<worker> & workers, const char * reason, double elapsed)
+{
+  coverage cv = get_coverage (workers);
+  size_t bytes = 0, errors = resumed.errors + verifier_found.load (std::memory_order_relaxed);
+  for (auto & w : workers)
+  {
+    bytes += w.bytes_tested.load (std::memory_order_relaxed);
+    errors += w.errors.load (std::memory_order_relaxed);
+  }
+  double rate = elapsed > 0 ? bytes / elapsed / 1e9 : 0;
+  bool failed = run_failed ();
+  if (opts.json)
+    printf ("{\"type\":\"done\",\"reason\":\"%s\",\"time\":%.3f,\"held_bytes\":%zu,\"passes\":%zu,"
+            "\"tested_bytes\":%zu,\"rate_gbps\":%.3f,\"errors\":%zu,\"result\":\"%s\"}\n",
+            reason, elapsed, cv.held_bytes, cv.passes, bytes, rate, errors, failed ? "fail" : "pass");
+  else
+    fprintf (stderr, "done (%s): time=%.0fs held=%.1fGB covered by %zu passes tested=%.1fGB rate=%.2fGB/s errors=%zu: %s\n",
+             reason, elapsed, cv.held_bytes / 1e9, cv.passes, bytes / 1e9, rate, errors, failed ? "FAIL" : "PASS");
+}
+
+static shm_stats * shm = 0;
+
+static void shm_open_stats (const char * name)
+{
+  std::string path = std::string ("/dev/shm/") + name;
+  int fd = open (path.c_str (), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate (fd, sizeof (shm_stats)) != 0)
+  {
+    fprintf (stderr, "failed to create stats page '%s': %s\n", path.c_str (), strerror (errno));
+    exit (1);
+  }
+  void * p = mmap (0, sizeof (shm_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (p == MAP_FAILED)
+  {
+    fprintf (stderr, "failed to map stats page '%s': %s\n", path.c_str (), strerror (errno));
+    exit (1);
+  }
+  shm = (shm_stats *)p;
+  shm->size = sizeof (shm_stats);
+  shm->pid = getpid ();
+  memcpy (shm->magic, "XMMSTAT1", sizeof (shm->magic));
+}
+
+// Builds a snapshot off the page, then copies it in under odd 'seq'.
+static void shm_publish (std::vector<worker> & workers, double elapsed)
+{
+  static double last_time = 0;
+  static size_t last_bytes = 0;
+  static double rate = 0;
+
+  shm_stats b;
+  memset (&b, 0, sizeof (b));
+  size_t rechecked = verifier_bytes.load (std::memory_order_relaxed);
+  b.iterations = resumed.iterations;
+  b.tested_bytes = resumed.bytes;
+  b.errors = resumed.errors + verifier_found.load (std::memory_order_relaxed);
+  for (auto & w : workers)
+  {
+    b.iterations += w.iterations.load (std::memory_order_relaxed);
+    b.tested_bytes += w.bytes_tested.load (std::memory_order_relaxed);
+    rechecked += w.bytes_rechecked.load (std::memory_order_relaxed);
+    b.errors += w.errors.load (std::memory_order_relaxed);
+  }
+  b.rechecked_bytes = rechecked;
+  if (elapsed - last_time >= 1.0)
+  {
+    rate = (b.tested_bytes - last_bytes) / (elapsed - last_time) / 1e9;
+    last_time = elapsed;
+    last_bytes = b.tested_bytes;
+  }
+  b.time = elapsed;
+  b.rate_gbps = rate;
+
+  coverage cv = get_coverage (workers);
+  b.stash_chunks = cv.chunks;
+  b.stash_bytes = cv.stash_bytes;
+  b.stash_passes = cv.stash_passes;
+  snprintf (b.kernel, sizeof (b.kernel), "%s", kernel->name);
+  for (int i = 0; i < STORE_POLICIES; i++)
+  {
+    snprintf (b.store_names[i], sizeof (b.store_names[i]), "%s", store_names[i]);
+    b.store_bytes[i] = store_bytes[i].load (std::memory_order_relaxed);
+    b.store_errors[i] = store_errors[i].load (std::memory_order_relaxed);
+  }
+  {
+    std::lock_guard<std::mutex> guard(mask_errors_lock);
+    std::vector<std::pair<size_t, u32>> top;
+    for (auto & m : mask_errors)
+    {
+      for (int bit = 0; bit < 32; bit++)
+        if (m.first & (1u << bit))
+          b.bit_errors[bit] += m.second;
+      top.push_back (std::make_pair (m.second, m.first));
+    }
+    std::sort (top.rbegin (), top.rend ());
+    for (size_t i = 0; i < top.size () && i < shm_masks; i++)
+    {
+      b.masks[i].mask = top[i].second;
+      b.masks[i].count = top[i].first;
+    }
+  }
+
+  uint64_t seq = shm->seq;
+  __atomic_store_n (&shm->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  memcpy (&shm->time, &b.time, sizeof (b) - offsetof (shm_stats, time));
+  __atomic_store_n (&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void usage (const char * argv0)
+{
+  fprintf (stderr,
+           "Usage: %s [options]\n"
+           "  -j, --threads=N        number of worker threads (default: one per allowed CPU)\n"
+           "      --no-pin           do not pin worker threads to CPUs\n"
+           "  -s, --chunk-size=MiB   scratch buffer and stash chunk size (default: 128)\n"
+           "  -i, --interval=SEC     stats reporting interval (default: 10)\n"
+           "  -k, --kernel=NAME      memmove kernel: avx512, avx2, sse2 (default: widest supported)\n"
+           "  -p, --store=POLICY[,POLICY...]  kernel store policy: nt, movdqu, clflushopt, clwb, movsb\n"
+           "                         (default: nt); several policies alternate on the same buffer\n"
+           "  -r, --headroom=MiB     available memory to leave to the rest of the system (default: 5%% of RAM)\n"
+           "      --grow-step=MiB    max stash growth per second (default: 1/16 of RAM, at least 1GiB)\n"
+           "  -a, --alloc=NAME       buffer allocator: malloc, populate, hugetlb, hugetlb-1g, thp (default: populate)\n"
+           "      --numa[=MODE]      bind buffers to NUMA nodes: local (default) or cross (remote node)\n"
+           "      --json             print stats as JSON lines to stdout\n"
+           "      --error-format=FMT error lines format: text, json, csv (default: text)\n"
+           "      --error-log=FILE   write error lines to FILE instead of stderr\n"
+           "      --error-rate=N     max error lines per second (default: 20)\n"
+           "      --pattern=NAME[,NAME...]  data pattern: seq, hash, walk1, walk0, checker, all (default: all)\n"
+           "      --streams=N[,N...] split memmove into N concurrently written NT streams (default: 1)\n"
+           "      --load=KIND[@GBPS][,...]  background load threads: read, write, copy, with target GB/s\n"
+           "      --load-size=MiB    buffer per load thread (default: 256)\n"
+           "      --load-sibling     pin load threads to SMT siblings of worker CPUs\n"
+           "      --checksum         fill stash with patterns, recheck it against per-4KiB CRC32C index\n"
+           "      --verifier         background thread rechecking idle stash chunks back to back\n"
+           "      --perf             hardware counters (perf_event_open) per phase, clean vs failing passes\n"
+           "      --focus[=SEC]      retest 64KiB around a new bad word for SEC seconds (default: 10)\n"
+           "      --passes=K         stop once all held memory was a memmove destination K times\n"
+           "      --time=SEC         stop after SEC seconds\n"
+           "      --bytes=GB         stop after testing GB gigabytes\n"
+           "      --shm=NAME         publish live stats in seqlock protected /dev/shm/NAME\n"
+           "      --sweep            many moves of glibc dispatch sizes, alignments and overlaps per pass\n"
+           "      --verify=MODE      cached (default) or dram: flush caches, verify with streaming loads\n"
+           "      --reread-delay=MS  once per iteration verify last destination again from DRAM MS ms later\n"
+           "      --journal=FILE     keep persistent run journal in FILE\n"
+           "      --journal-size=MiB journal size (default: 1024)\n"
+           "      --resume           continue counters and error index from existing journal\n"
+           "      --dimm-map=FILE    physical address ranges to DIMM labels: '<first> <last> <label>' lines\n"
+           "  -h, --help             this help\n",
+           argv0);
+}
+
+static size_t parse_size (const char * argv0, const char * arg)
+{
+  char * end;
+  unsigned long long v = strtoull (arg, &end, 0);
+  if (*arg == '\0' || *end != '\0')
+  {
+    fprintf (stderr, "%s: bad number '%s'\n", argv0, arg);
+    exit (1);
+  }
+  return v;
+}
+
+static void parse_args (int argc, char * argv[])
+{
+  enum { OPT_NO_PIN = 256, OPT_DIMM_MAP, OPT_NUMA, OPT_JSON, OPT_GROW_STEP,
+         OPT_ERROR_FORMAT, OPT_ERROR_LOG, OPT_ERROR_RATE, OPT_JOURNAL, OPT_JOURNAL_SIZE, OPT_RESUME,
+         OPT_VERIFY, OPT_REREAD_DELAY, OPT_PATTERN, OPT_SWEEP, OPT_STREAMS, OPT_LOAD, OPT_LOAD_SIZE,
+         OPT_LOAD_SIBLING, OPT_CHECKSUM, OPT_VERIFIER, OPT_PERF, OPT_FOCUS,
+         OPT_PASSES, OPT_TIME, OPT_BYTES, OPT_SHM };
+  static const struct option long_opts[] = {
+    { "threads",    required_argument, 0, 'j' },
+    { "no-pin",     no_argument,       0, OPT_NO_PIN },
+    { "chunk-size", required_argument, 0, 's' },
+    { "interval",   required_argument, 0, 'i' },
+    { "kernel",     required_argument, 0, 'k' },
+    { "dimm-map",   required_argument, 0, OPT_DIMM_MAP },
+    { "alloc",      required_argument, 0, 'a' },
+    { "store",      required_argument, 0, 'p' },
+    { "headroom",   required_argument, 0, 'r' },
+    { "grow-step",  required_argument, 0, OPT_GROW_STEP },
+    { "error-format", required_argument, 0, OPT_ERROR_FORMAT },
+    { "error-log",  required_argument, 0, OPT_ERROR_LOG },
+    { "error-rate", required_argument, 0, OPT_ERROR_RATE },
+    { "journal",    required_argument, 0, OPT_JOURNAL },
+    { "journal-size", required_argument, 0, OPT_JOURNAL_SIZE },
+    { "resume",     no_argument,       0, OPT_RESUME },
+    { "verify",     required_argument, 0, OPT_VERIFY },
+    { "pattern",    required_argument, 0, OPT_PATTERN },
+    { "sweep",      no_argument,       0, OPT_SWEEP },
+    { "streams",    required_argument, 0, OPT_STREAMS },
+    { "load",       required_argument, 0, OPT_LOAD },
+    { "load-size",  required_argument, 0, OPT_LOAD_SIZE },
+    { "load-sibling", no_argument,     0, OPT_LOAD_SIBLING },
+    { "checksum",   no_argument,       0, OPT_CHECKSUM },
+    { "verifier",   no_argument,       0, OPT_VERIFIER },
+    { "perf",       no_argument,       0, OPT_PERF },
+    { "focus",      optional_argument, 0, OPT_FOCUS },
+    { "passes",     required_argument, 0, OPT_PASSES },
+    { "time",       required_argument, 0, OPT_TIME },
+    { "bytes",      required_argument, 0, OPT_BYTES },
+    { "shm",        required_argument, 0, OPT_SHM },
+    { "reread-delay", required_argument, 0, OPT_REREAD_DELAY },
+    { "numa",       optional_argument, 0, OPT_NUMA },
+    { "json",       no_argument,       0, OPT_JSON },
+    { "help",       no_argument,       0, 'h' },
+    { 0, 0, 0, 0 },
+  };
+
+  for (;;)
+  {
+    int c = getopt_long (argc, argv, "j:s:i:k:a:p:r:h", long_opts, 0);
+    if (c == -1) break;
+    switch (c)
+    {
+      case 'j': opts.threads = parse_size (argv[0], optarg); break;
+      case OPT_NO_PIN: opts.pin = false; break;
+      case 's': opts.chunk_size = parse_size (argv[0], optarg) * 1024 * 1024; break;
+      case 'i': opts.interval = parse_size (argv[0], optarg); break;
+      case 'k': opts.kernel = optarg; break;
+      case OPT_DIMM_MAP: opts.dimm_map = optarg; break;
+      case 'a': opts.alloc = optarg; break;
+      case 'p': opts.store = optarg; break;
+      case 'r': opts.headroom = parse_size (argv[0], optarg) * 1024 * 1024; break;
+      case OPT_GROW_STEP: opts.grow_step = parse_size (argv[0], optarg) * 1024 * 1024; break;
+      case OPT_ERROR_FORMAT: opts.error_format = optarg; break;
+      case OPT_ERROR_LOG: opts.error_log = optarg; break;
+      case OPT_ERROR_RATE: opts.error_rate = parse_size (argv[0], optarg); break;
+      case OPT_JOURNAL: opts.journal = optarg; break;
+      case OPT_JOURNAL_SIZE: opts.journal_size = parse_size (argv[0], optarg) * 1024 * 1024; break;
+      case OPT_RESUME: opts.resume = true; break;
+      case OPT_VERIFY:
+        if (strcmp (optarg, "cached") != 0 && strcmp (optarg, "dram") != 0)
+        {
+          fprintf (stderr, "%s: unknown verify mode '%s'\n", argv[0], optarg);
+          exit (1);
+        }
+        opts.verify_dram = strcmp (optarg, "dram") == 0;
+        break;
+      case OPT_REREAD_DELAY: opts.reread_delay = parse_size (argv[0], optarg); break;
+      case OPT_PATTERN: opts.pattern = optarg; break;
+      case OPT_SWEEP: opts.sweep = true; break;
+      case OPT_STREAMS: opts.streams = optarg; break;
+      case OPT_LOAD: opts.load = optarg; break;
+      case OPT_LOAD_SIZE: opts.load_size = parse_size (argv[0], optarg) * 1024 * 1024; break;
+      case OPT_LOAD_SIBLING: opts.load_sibling = true; break;
+      case OPT_CHECKSUM: opts.checksum = true; break;
+      case OPT_VERIFIER: opts.verifier = true; break;
+      case OPT_PERF: opts.perf = true; break;
+      case OPT_FOCUS: opts.focus = optarg ? parse_size (argv[0], optarg) : 10; break;
+      case OPT_PASSES: opts.passes = parse_size (argv[0], optarg); break;
+      case OPT_TIME: opts.time = parse_size (argv[0], optarg); break;
+      case OPT_BYTES: opts.bytes = parse_size (argv[0], optarg) * 1000 * 1000 * 1000; break;
+      case OPT_SHM: opts.shm = optarg; break;
+      case OPT_NUMA: opts.numa = optarg ? optarg : "local"; break;
+      case OPT_JSON: opts.json = true; break;
+      case 'h': usage (argv[0]); exit (0);
+      default: usage (argv[0]); exit (1);
+    }
+  }
+  if (opts.numa && strcmp (opts.numa, "local") != 0 && strcmp (opts.numa, "cross") != 0)
+  {
+    fprintf (stderr, "%s: unknown NUMA mode '%s'\n", argv[0], opts.numa);
+    exit (1);
+  }
+  if (strcmp (opts.error_format, "text") != 0 && strcmp (opts.error_format, "json") != 0
+      && strcmp (opts.error_format, "csv") != 0)
+  {
+    fprintf (stderr, "%s: unknown error format '%s'\n", argv[0], opts.error_format);
+    exit (1);
+  }
+  if (opts.resume && !opts.journal)
+  {
+    fprintf (stderr, "%s: --resume needs --journal\n", argv[0]);
+    exit (1);
+  }
+  if (optind != argc || opts.chunk_size == 0)
+  {
+    usage (argv[0]);
+    exit (1);
+  }
+}
+
+int main (int argc, char * argv[])
+{
+  parse_args (argc, argv);
+
+  kernel = pick_kernel (opts.kernel);
+  if (!kernel)
+  {
+    fprintf (stderr, "%s: unknown kernel '%s'\n", argv[0], opts.kernel);
+    exit (1);
+  }
+  if (!kernel->supported ())
+  {
+    fprintf (stderr, "%s: kernel '%s' is not supported by this CPU\n", argv[0], kernel->name);
+    exit (1);
+  }
+  widest = pick_kernel (0);
+  if ((opts.verify_dram || opts.reread_delay) && !__builtin_cpu_supports ("sse4.1"))
+  {
+    fprintf (stderr, "%s: --verify=dram and --reread-delay need movntdqa (SSE4.1), not supported by this CPU\n", argv[0]);
+    exit (1);
+  }
+  if (opts.checksum && !__builtin_cpu_supports ("sse4.2"))
+  {
+    fprintf (stderr, "%s: --checksum needs crc32 (SSE4.2), not supported by this CPU\n", argv[0]);
+    exit (1);
+  }
+
+  std::string policies = opts.store;
+  for (size_t pos = 0; pos <= policies.size (); )
+  {
+    size_t comma = policies.find (',', pos);
+    if (comma == std::string::npos)
+      comma = policies.size ();
+    std::string name = policies.substr (pos, comma - pos);
+    int store = 0;
+    while (store < STORE_POLICIES && name != store_names[store])
+      ++store;
+    if (store == STORE_POLICIES)
+    {
+      fprintf (stderr, "%s: unknown store policy '%s'\n", argv[0], name.c_str ());
+      exit (1);
+    }
+    if (!store_supported (store))
+    {
+      fprintf (stderr, "%s: store policy '%s' is not supported by this CPU\n", argv[0], name.c_str ());
+      exit (1);
+    }
+    store_policies.push_back (store);
+    pos = comma + 1;
+  }
+
+  for (const char * p = opts.streams; ; )
+  {
+    char * end;
+    unsigned long n = strtoul (p, &end, 0);
+    if (end == p || n == 0 || (*end != ',' && *end != '\0'))
+    {
+      fprintf (stderr, "%s: bad stream count list '%s'\n", argv[0], opts.streams);
+      exit (1);
+    }
+    stream_counts.push_back (n);
+    if (*end == '\0')
+      break;
+    p = end + 1;
+  }
+  if (opts.sweep && (stream_counts.size () > 1 || stream_counts[0] > 1))
+  {
+    fprintf (stderr, "%s: --streams does not apply to --sweep\n", argv[0]);
+    exit (1);
+  }
+  if (opts.sweep && opts.passes)
+  {
+    fprintf (stderr, "%s: --passes does not apply to --sweep, use --time or --bytes\n", argv[0]);
+    exit (1);
+  }
+  if (*std::max_element (stream_counts.begin (), stream_counts.end ()) > 1
+      && std::find (store_policies.begin (), store_policies.end (), (int)STORE_MOVSB) != store_policies.end ())
+  {
+    fprintf (stderr, "%s: store policy 'movsb' can not be split into --streams\n", argv[0]);
+    exit (1);
+  }
+
+  std::vector<std::pair<int, double>> load_specs; // (kind, target GB/s)
+  std::string load_list = opts.load ? opts.load : "";
+  for (size_t pos = 0; opts.load && pos <= load_list.size (); )
+  {
+    size_t comma = load_list.find (',', pos);
+    if (comma == std::string::npos)
+      comma = load_list.size ();
+    std::string spec = load_list.substr (pos, comma - pos);
+    size_t at = spec.find ('@');
+    std::string name = spec.substr (0, at);
+    double target = at == std::string::npos ? 0 : atof (spec.c_str () + at + 1);
+    int kind = 0;
+    while (kind < LOAD_KINDS && name != load_names[kind])
+      ++kind;
+    if (kind == LOAD_KINDS || target < 0)
+    {
+      fprintf (stderr, "%s: bad load '%s'\n", argv[0], spec.c_str ());
+      exit (1);
+    }
+    load_specs.push_back (std::make_pair (kind, target));
+    pos = comma + 1;
+  }
+
+  std::string pattern_list = opts.pattern;
+  for (size_t pos = 0; pos <= pattern_list.size (); )
+  {
+    size_t comma = pattern_list.find (',', pos);
+    if (comma == std::string::npos)
+      comma = pattern_list.size ();
+    std::string name = pattern_list.substr (pos, comma - pos);
+    if (name == "all")
+    {
+      for (int p = 0; p < PATTERNS; p++)
+        patterns.push_back (p);
+    }
+    else
+    {
+      int p = 0;
+      while (p < PATTERNS && name != pattern_names[p])
+        ++p;
+      if (p == PATTERNS)
+      {
+        fprintf (stderr, "%s: unknown pattern '%s'\n", argv[0], name.c_str ());
+        exit (1);
+      }
+      patterns.push_back (p);
+    }
+    pos = comma + 1;
+  }
+  struct timespec ts;
+  clock_gettime (CLOCK_REALTIME, &ts);
+  pattern_seed = hash32 ((u32)ts.tv_nsec ^ (u32)ts.tv_sec ^ (u32)getpid ());
+
+  for (auto & a : allocators)
+    if (strcmp (opts.alloc, a.name) == 0)
+      buf_allocator = &a;
+  if (!buf_allocator)
+  {
+    fprintf (stderr, "%s: unknown allocator '%s'\n", argv[0], opts.alloc);
+    exit (1);
+  }
+  if (opts.chunk_size % buf_allocator->granule)
+  {
+    opts.chunk_size += buf_allocator->granule - opts.chunk_size % buf_allocator->granule;
+    fprintf (stderr, "chunk size rounded up to %zu bytes for '%s' allocator\n", opts.chunk_size, buf_allocator->name);
+  }
+
+  page_size = sysconf (_SC_PAGESIZE);
+  pagemap_fd = open ("/proc/self/pagemap", O_RDONLY);
+  if (geteuid () != 0)
+    fprintf (stderr, "not running as root: errors are reported with virtual addresses only\n");
+  if (opts.dimm_map)
+    load_dimm_map (opts.dimm_map);
+
+  fprintf (stderr, "using kernel: %s (%zu-bit registers), store policy: %s, pattern: %s\n",
+           kernel->name, kernel->width * 8, opts.store, opts.pattern);
+  // a quarter of the half moved per pass: leaves room for smaller sizes
+  if (opts.sweep)
+    init_sweep_sizes (opts.chunk_size / 8);
+
+  // CPUs we are allowed to run on (respects taskset/cgroups)
+  std::vector<int> cpus;
+  cpu_set_t allowed;
+  if (sched_getaffinity (0, sizeof (allowed), &allowed) == 0)
+  {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET (cpu, &allowed))
+        cpus.push_back (cpu);
+  }
+  if (cpus.empty ())
+    cpus.push_back (0);
+
+  size_t nthreads = opts.threads ? opts.threads : cpus.size ();
+  std::vector<worker> workers (nthreads);
+  for (size_t i = 0; i < nthreads; ++i)
+  {
+    workers[i].id = i;
+    workers[i].cpu = opts.pin ? cpus[i % cpus.size ()] : -1;
+    workers[i].node = -1;
+    workers[i].mem_node = -1;
+  }
+
+  if (opts.numa)
+  {
+    std::vector<numa_node> nodes = discover_numa_nodes (allowed);
+    std::vector<const numa_node *> cpu_nodes;
+    for (auto & n : nodes)
+      if (!n.cpus.empty ())
+        cpu_nodes.push_back (&n);
+    if (cpu_nodes.empty ())
+    {
+      fprintf (stderr, "%s: no NUMA nodes found in sysfs\n", argv[0]);
+      exit (1);
+    }
+    if (strcmp (opts.numa, "cross") == 0 && nodes.size () < 2)
+      fprintf (stderr, "single NUMA node: cross-node mode tests local memory\n");
+    // Spread workers over nodes round-robin, each one runs on node's CPUs.
+    // In cross mode memory comes from the next node (remote traffic).
+    for (size_t i = 0; i < nthreads; ++i)
+    {
+      const numa_node * n = cpu_nodes[i % cpu_nodes.size ()];
+      size_t k = 0;
+      while (nodes[k].id != n->id)
+        ++k;
+      workers[i].node = n->id;
+      workers[i].mem_node = strcmp (opts.numa, "cross") == 0 ? nodes[(k + 1) % nodes.size ()].id : n->id;
+      if (opts.pin)
+        workers[i].cpu = n->cpus[(i / cpu_nodes.size ()) % n->cpus.size ()];
+    }
+    for (auto & n : nodes)
+      fprintf (stderr, "numa node%d: %zu allowed cpus\n", n.id, n.cpus.size ());
+  }
+
+  if (opts.journal)
+    journal_open (opts.journal, opts.journal_size, opts.resume);
+  run_start = now_seconds () - resumed.time;
+
+  error_log = stderr;
+  if (opts.error_log && !(error_log = fopen (opts.error_log, "a")))
+  {
+    fprintf (stderr, "%s: failed to open '%s': %s\n", argv[0], opts.error_log, strerror (errno));
+    exit (1);
+  }
+  std::vector<error_ring *> rings;
+  for (auto & w : workers)
+    rings.push_back (&w.errors_found);
+  rings.push_back (&verifier_errors);
+  std::thread reporter (reporter_loop, rings);
+
+  for (auto & w : workers)
+    w.thread = std::thread (worker_loop, &w);
+
+  size_t total;
+  meminfo_available (&total);
+  if (!opts.headroom)
+    opts.headroom = std::max (total / 20, (size_t)256 * 1024 * 1024);
+  if (!opts.grow_step)
+    opts.grow_step = std::max (total / 16, (size_t)1024 * 1024 * 1024);
+  fprintf (stderr, "memory headroom: %zuMB, available now: %zuMB\n", opts.headroom >> 20, available_memory () >> 20);
+  std::vector<int> mem_nodes;
+  for (auto & w : workers)
+    if (std::find (mem_nodes.begin (), mem_nodes.end (), w.mem_node) == mem_nodes.end ())
+      mem_nodes.push_back (w.mem_node);
+  std::thread pressure (pressure_loop, mem_nodes);
+  if (opts.verifier)
+    std::thread (verifier_loop).detach ();
+
+  // --load: background traffic, optionally next to workers on their SMT siblings
+  std::vector<load_gen> loads (load_specs.size ());
+  for (size_t i = 0; i < loads.size (); ++i)
+  {
+    loads[i].kind = load_specs[i].first;
+    loads[i].target = load_specs[i].second;
+    loads[i].cpu = -1;
+    if (opts.load_sibling)
+    {
+      int cpu = workers[i % workers.size ()].cpu;
+      loads[i].cpu = cpu >= 0 ? smt_sibling (cpu) : -1;
+      if (loads[i].cpu < 0)
+        fprintf (stderr, "load %zu: no SMT sibling of worker cpu %d, not pinned\n", i, cpu);
+    }
+    loads[i].thread = std::thread (load_loop, &loads[i]);
+  }
+
+  if (opts.shm)
+    shm_open_stats (opts.shm);
+  stats_state st = { resumed.time, resumed.bytes, {}, { 0, 0, 0 }, resumed.errors, {} };
+  const double started = now_seconds ();
+  double next_stats = opts.interval;
+  for (;;)
+  {
+    usleep (100 * 1000);
+    if (shm)
+      shm_publish (workers, now_seconds () - run_start);
+    const char * done = run_done (workers, now_seconds () - started);
+    if (done || now_seconds () - started >= next_stats)
+    {
+      print_stats (workers, loads, now_seconds () - run_start, st);
+      journal_sync ();
+      next_stats += opts.interval;
+    }
+    if (done)
     {
-        if (0) free_ram();
+      print_run_summary (workers, done, now_seconds () - started);
+      journal_sync ();
+      fflush (0);
+      // workers are still running: skip static destructors under their feet
+      _exit (run_failed () ? 1 : 0);
     }
-    else if (n % 10 == 0)
-        take_ram();
   }
 }